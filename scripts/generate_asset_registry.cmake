@@ -0,0 +1,154 @@
+# Writes a C++ header describing every file in the assets folder, so that the
+# app refers to assets by ID instead of by path string.
+#
+# Usage: cmake -DASSET_DIR=<assets folder> -DOUTPUT=<header> -P <this file>
+#
+# For each asset the header records its path relative to the base path, size,
+# type and offset in the pack layout (all assets back to back, each starting
+# on a kAssetPackAlignment boundary), which lets a loader read everything into
+# one preallocated buffer.
+#
+# Images may come in density variants named name@2x.ext, name@4x.ext next to
+# name.ext; each variant is an asset of its own that records the ID of the
+# plain one as its base, and its scale. PNG dimensions are read from the IHDR
+# chunk so the app can pick a variant without decoding any of them.
+
+cmake_minimum_required(VERSION 3.21)
+
+if(NOT ASSET_DIR OR NOT OUTPUT)
+  message(FATAL_ERROR "ASSET_DIR and OUTPUT must be set")
+endif()
+
+set(alignment 64)
+
+file(
+  GLOB assets
+  LIST_DIRECTORIES false
+  RELATIVE "${ASSET_DIR}"
+  "${ASSET_DIR}/*")
+list(SORT assets)
+
+set(ids "")
+set(entries "")
+set(offset 0)
+foreach(asset IN LISTS assets)
+  file(SIZE "${ASSET_DIR}/${asset}" size)
+
+  get_filename_component(ext "${asset}" LAST_EXT)
+  string(TOLOWER "${ext}" ext)
+  if(ext MATCHES "^\\.(png|jpe?g)$")
+    set(type Image)
+  elseif(ext MATCHES "^\\.(ttf|otf)$")
+    set(type Font)
+  elseif(ext MATCHES "^\\.(ogg|wav|mp3)$")
+    set(type Audio)
+  elseif(ext STREQUAL ".svg")
+    set(type Vector)
+  else()
+    set(type Other)
+  endif()
+
+  # name@<scale>x.ext is a variant of name.ext, if that exists
+  set(scale 1)
+  set(base "${asset}")
+  if(asset MATCHES "^(.+)@([0-9]+)x(\\.[^.]+)$")
+    set(scale ${CMAKE_MATCH_2})
+    if("${CMAKE_MATCH_1}${CMAKE_MATCH_3}" IN_LIST assets)
+      set(base "${CMAKE_MATCH_1}${CMAKE_MATCH_3}")
+    endif()
+  endif()
+
+  # PNG: signature, then IHDR with big-endian width and height at byte 16
+  set(width 0)
+  set(height 0)
+  if(ext STREQUAL ".png" AND size GREATER_EQUAL 24)
+    file(READ "${ASSET_DIR}/${asset}" ihdr OFFSET 12 LIMIT 12 HEX)
+    if(ihdr MATCHES "^49484452(........)(........)$")
+      math(EXPR width "0x${CMAKE_MATCH_1}")
+      math(EXPR height "0x${CMAKE_MATCH_2}")
+    endif()
+  endif()
+
+  string(MAKE_C_IDENTIFIER "${asset}" id)
+  string(MAKE_C_IDENTIFIER "${base}" base_id)
+  string(APPEND ids "  ${id},\n")
+  string(
+    APPEND
+    entries
+    "    {.path = \"assets/${asset}\",\n"
+    "     .hash = AssetHash(\"assets/${asset}\"),\n"
+    "     .size = ${size},\n"
+    "     .offset = ${offset},\n"
+    "     .type = AssetType::${type},\n"
+    "     .base = AssetId::${base_id},\n"
+    "     .scale = ${scale},\n"
+    "     .width = ${width},\n"
+    "     .height = ${height}},\n")
+
+  math(EXPR offset
+       "(${offset} + ${size} + ${alignment} - 1) / ${alignment} * ${alignment}")
+endforeach()
+
+file(
+  WRITE "${OUTPUT}.tmp"
+  "// Generated by scripts/generate_asset_registry.cmake from the assets folder.
+// Do not edit; add or remove files in assets/ and rebuild instead.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+enum class AssetType : uint8_t { Image, Font, Audio, Vector, Other };
+
+enum class AssetId : uint16_t {
+${ids}};
+
+struct AssetInfo {
+  const char *path; // relative to the base path
+  uint64_t hash;    // AssetHash(path)
+  uint64_t size;    // bytes, when the app was built
+  uint64_t offset;  // in the pack layout
+  AssetType type;
+  AssetId base;    // the asset this is a density variant of, else itself
+  uint8_t scale;   // 2 for name@2x.png, 1 without a suffix
+  uint32_t width;  // image size in pixels where known (PNG), else 0
+  uint32_t height;
+};
+
+// FNV-1a, as used elsewhere in the app.
+constexpr uint64_t AssetHash(std::string_view path) {
+  uint64_t hash = 0xCBF29CE484222325ull;
+  for (char c : path) {
+    hash = (hash ^ static_cast<uint8_t>(c)) * 0x100000001B3ull;
+  }
+  return hash;
+}
+
+constexpr size_t kAssetPackAlignment = ${alignment};
+constexpr uint64_t kAssetPackBytes = ${offset};
+
+// Indexed by AssetId.
+constexpr AssetInfo kAssets[] = {
+${entries}};
+
+constexpr size_t kAssetCount = sizeof(kAssets) / sizeof(kAssets[0]);
+
+constexpr const AssetInfo &GetAsset(AssetId id) {
+  return kAssets[static_cast<size_t>(id)];
+}
+
+// The ID of the asset at `path`, e.g. FindAsset(\"assets/logo.png\"). A path
+// that isn't in the assets folder doesn't compile.
+consteval AssetId FindAsset(std::string_view path) {
+  const uint64_t hash = AssetHash(path);
+  for (size_t i = 0; i < kAssetCount; ++i) {
+    if (kAssets[i].hash == hash && path == kAssets[i].path) {
+      return static_cast<AssetId>(i);
+    }
+  }
+  throw \"no such asset\";
+}
+")
+file(COPY_FILE "${OUTPUT}.tmp" "${OUTPUT}" ONLY_IF_DIFFERENT)
+file(REMOVE "${OUTPUT}.tmp")
@@ -15,16 +15,50 @@
 #include <SDL3_mixer/SDL_mixer.h>
 #include <SDL3_ttf/SDL_ttf.h>
 
+#include "asset_registry.h" // generated from assets/ by CMake
+
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <coroutine>
 #include <cmath>
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <deque>
 #include <filesystem>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
 #include <string_view>
 #include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#if !defined(__EMSCRIPTEN__) && (defined(__unix__) || defined(__APPLE__))
+#define USE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                   \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define USE_SSE2 1
+#include <emmintrin.h>
+#endif
 
 constexpr uint32_t windowStartWidth = 400;
 constexpr uint32_t windowStartHeight = 400;
+constexpr float fontSize = 36.0f; // in points at a display scale of 1
+constexpr float uiFontSize = 16.0f;
 
 // ------------------- Simple OpenGL helpers -------------------
 
@@ -34,17 +68,101 @@ struct GLTexture {
   int height = 0;
 };
 
+struct GLVertex {
+  float x, y; // pixels, origin top-left
+  float u, v;
+  SDL_Color color; // multiplied with the texture
+};
+
+// Geometry queued for one draw call; see "Geometry batching" below.
+struct GLBatch {
+  std::vector<GLVertex> vertices;
+  std::vector<uint16_t> indices;
+  GLuint texture = 0;
+};
+
+constexpr int kBatchMaxVertices = 65536; // all addressable by 16-bit indices
+constexpr int kBatchMaxIndices = 3 * kBatchMaxVertices;
+
+// Per-frame counters, reset by BeginFrame.
+struct GLFrameStats {
+  uint64_t textureUploadBytes = 0;
+  int drawCalls = 0;
+  int batchedVertices = 0;
+  int objectsDeleted = 0;   // retired objects deleted
+  int texturesRecycled = 0; // textures reused instead of allocated
+  uint64_t frameWaitNS = 0; // waiting for the GPU after presenting
+  float latchShift = 0.0f;  // largest late-latch correction, pixels
+};
+
+// Vertices in the batch that follow the pointer; see "Late latching" below.
+struct GLLateLatch {
+  size_t first = 0; // into GLBatch::vertices
+  size_t end = 0;   // SIZE_MAX while still being drawn
+  float x = 0.0f;   // pointer position the vertices were built for
+  float y = 0.0f;
+};
+
+// Returns the newest pointer position in backbuffer pixels, or false if
+// there is none.
+using GLLatchSampler = bool (*)(void *userdata, float *x, float *y);
+
+// A GL object released while frames that used it may still be in flight;
+// see "Deferred destruction" below.
+struct GLRetiredObject {
+  enum class Kind : uint8_t {
+    Texture,
+    RecycledTexture,
+    Buffer,
+    Framebuffer,
+    Program
+  };
+  Kind kind = Kind::Texture;
+  GLuint id = 0;
+  int width = 0; // recycled textures only
+  int height = 0;
+  uint64_t frame = 0; // last frame that may use it
+};
+
+#ifndef __EMSCRIPTEN__
+struct GLFrameFence {
+  uint64_t frame = 0;
+  GLsync fence = nullptr;
+};
+#endif
+
 struct GLRenderer {
   SDL_GLContext context = nullptr;
 
+  GLFrameStats stats;     // frame currently being built
+  GLFrameStats lastStats; // previous completed frame
+
+  GLBatch batch;
+  GLTexture white; // 1x1 white texel for untextured geometry
+
+  uint64_t frame = 1;          // frame being built
+  uint64_t completedFrame = 0; // newest frame the GPU is done with; 0: none
+  std::vector<GLRetiredObject> retired;
+  std::vector<GLRetiredObject> recycled; // safe to reuse, oldest first
+#ifndef __EMSCRIPTEN__
+  std::deque<GLFrameFence> frameFences;
+#endif
+
+  std::vector<GLLateLatch> latches; // in the current batch
+  GLLatchSampler latchSampler = nullptr;
+  void *latchUserdata = nullptr;
+
 #ifdef __EMSCRIPTEN__
-  // Simple textured-quad shader pipeline for WebGL / GLES2
+  // Simple textured, vertex-coloured shader pipeline for WebGL / GLES2
   GLuint program = 0;
   GLuint vbo = 0;
+  GLuint ibo = 0;
   GLint uResolutionLoc = -1;
   GLint uTextureLoc = -1;
   GLint aPosLoc = -1;
   GLint aUVLoc = -1;
+  GLint aColorLoc = -1;
+  GLint uTranslateLoc = -1;
 #endif
 };
 
@@ -53,6 +171,15 @@ SDL_AppResult SDL_Fail() {
   return SDL_APP_FAILURE;
 }
 
+static uint64_t HashBytes(uint64_t hash, const void *data, size_t size) {
+  // FNV-1a
+  const auto *bytes = static_cast<const uint8_t *>(data);
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+  }
+  return hash;
+}
+
 #ifdef __EMSCRIPTEN__
 // ------------ GL function pointers loaded via SDL3 ------------
 
@@ -85,7 +212,7 @@ using GLBufferDataProc = void (*)(GLenum, std::intptr_t, const void *, GLenum);
 using GLEnableVertexAttribArrayProc = void (*)(GLuint);
 using GLVertexAttribPointerProc = void (*)(GLuint, GLint, GLenum, GLboolean,
                                            GLsizei, const void *);
-using GLDrawArraysProc = void (*)(GLenum, GLint, GLsizei);
+using GLDrawElementsProc = void (*)(GLenum, GLsizei, GLenum, const void *);
 
 using GLUniform2fProc = void (*)(GLint, GLfloat, GLfloat);
 using GLUniform1iProc = void (*)(GLint, GLint);
@@ -117,7 +244,7 @@ static GLBufferDataProc pglBufferData = nullptr;
 
 static GLEnableVertexAttribArrayProc pglEnableVertexAttribArray = nullptr;
 static GLVertexAttribPointerProc pglVertexAttribPointer = nullptr;
-static GLDrawArraysProc pglDrawArrays = nullptr;
+static GLDrawElementsProc pglDrawElements = nullptr;
 
 static GLUniform2fProc pglUniform2f = nullptr;
 static GLUniform1iProc pglUniform1i = nullptr;
@@ -160,7 +287,7 @@ static bool LoadGLES2Functions() {
 
   LOAD_GL_FUNC(glEnableVertexAttribArray);
   LOAD_GL_FUNC(glVertexAttribPointer);
-  LOAD_GL_FUNC(glDrawArrays);
+  LOAD_GL_FUNC(glDrawElements);
 
   LOAD_GL_FUNC(glUniform2f);
   LOAD_GL_FUNC(glUniform1i);
@@ -211,12 +338,15 @@ precision mediump float;
 
 attribute vec2 aPos;
 attribute vec2 aUV;
+attribute vec4 aColor;
 varying vec2 vUV;
+varying vec4 vColor;
 uniform vec2 uResolution;
+uniform vec2 uTranslate; // pixel offset, e.g. a camera
 
 void main() {
     // Convert from pixel coordinates (0..width, 0..height) to clip space.
-    vec2 zeroToOne = aPos / uResolution;
+    vec2 zeroToOne = (aPos + uTranslate) / uResolution;
     vec2 zeroToTwo = zeroToOne * 2.0;
     vec2 clipSpace = zeroToTwo - 1.0;
 
@@ -225,6 +355,7 @@ void main() {
 
     gl_Position = vec4(clipSpace, 0.0, 1.0);
     vUV = aUV;
+    vColor = aColor;
 }
 )";
 
@@ -234,10 +365,11 @@ precision mediump float;
 #endif
 
 varying vec2 vUV;
+varying vec4 vColor;
 uniform sampler2D uTexture;
 
 void main() {
-    gl_FragColor = texture2D(uTexture, vUV);
+    gl_FragColor = texture2D(uTexture, vUV) * vColor;
 }
 )";
 
@@ -286,6 +418,346 @@ void main() {
 }
 #endif // __EMSCRIPTEN__
 
+// ------------ Optional GL entry points (all platforms) ------------
+
+// Functions that are not guaranteed by the GL 2.1 / GLES2 baseline we request.
+// They stay nullptr when unsupported and callers fall back accordingly.
+#ifndef GL_RGBA8
+#define GL_RGBA8 0x8058 // GL_RGBA8_OES in GLES2 headers
+#endif
+#ifndef GL_TIME_ELAPSED
+#define GL_TIME_ELAPSED 0x88BF
+#define GL_QUERY_RESULT 0x8866
+#define GL_QUERY_RESULT_AVAILABLE 0x8867
+#endif
+
+#ifndef __EMSCRIPTEN__
+// Buffer objects are core since GL 1.5, but like everything past 1.1 they
+// have to be looked up on some platforms. The GLES2 path loads them above.
+using GLGenBuffersProc = void (*)(GLsizei, GLuint *);
+using GLDeleteBuffersProc = void (*)(GLsizei, const GLuint *);
+using GLBindBufferProc = void (*)(GLenum, GLuint);
+using GLBufferDataProc = void (*)(GLenum, std::intptr_t, const void *, GLenum);
+
+static GLGenBuffersProc pglGenBuffers = nullptr;
+static GLDeleteBuffersProc pglDeleteBuffers = nullptr;
+static GLBindBufferProc pglBindBuffer = nullptr;
+static GLBufferDataProc pglBufferData = nullptr;
+
+// Fences (GL 3.2 / ARB_sync) let one context wait for work submitted by
+// another; the background uploader needs them.
+using GLFenceSyncProc = GLsync (*)(GLenum, GLbitfield);
+using GLClientWaitSyncProc = GLenum (*)(GLsync, GLbitfield, uint64_t);
+using GLDeleteSyncProc = void (*)(GLsync);
+
+static GLFenceSyncProc pglFenceSync = nullptr;
+static GLClientWaitSyncProc pglClientWaitSync = nullptr;
+static GLDeleteSyncProc pglDeleteSync = nullptr;
+#endif
+
+using GLTexStorage2DProc = void (*)(GLenum, GLsizei, GLenum, GLsizei, GLsizei);
+using GLGenerateMipmapProc = void (*)(GLenum);
+
+using GLGenFramebuffersProc = void (*)(GLsizei, GLuint *);
+using GLDeleteFramebuffersProc = void (*)(GLsizei, const GLuint *);
+using GLBindFramebufferProc = void (*)(GLenum, GLuint);
+using GLFramebufferTexture2DProc = void (*)(GLenum, GLenum, GLenum, GLuint,
+                                            GLint);
+using GLCheckFramebufferStatusProc = GLenum (*)(GLenum);
+
+using GLGenQueriesProc = void (*)(GLsizei, GLuint *);
+using GLDeleteQueriesProc = void (*)(GLsizei, const GLuint *);
+using GLBeginQueryProc = void (*)(GLenum, GLuint);
+using GLEndQueryProc = void (*)(GLenum);
+using GLGetQueryObjectivProc = void (*)(GLuint, GLenum, GLint *);
+using GLGetQueryObjectui64vProc = void (*)(GLuint, GLenum, uint64_t *);
+
+static GLTexStorage2DProc pglTexStorage2D = nullptr;
+static GLGenerateMipmapProc pglGenerateMipmap = nullptr;
+
+static GLGenFramebuffersProc pglGenFramebuffers = nullptr;
+static GLDeleteFramebuffersProc pglDeleteFramebuffers = nullptr;
+static GLBindFramebufferProc pglBindFramebuffer = nullptr;
+static GLFramebufferTexture2DProc pglFramebufferTexture2D = nullptr;
+static GLCheckFramebufferStatusProc pglCheckFramebufferStatus = nullptr;
+
+static GLGenQueriesProc pglGenQueries = nullptr;
+static GLDeleteQueriesProc pglDeleteQueries = nullptr;
+static GLBeginQueryProc pglBeginQuery = nullptr;
+static GLEndQueryProc pglEndQuery = nullptr;
+static GLGetQueryObjectivProc pglGetQueryObjectiv = nullptr;
+static GLGetQueryObjectui64vProc pglGetQueryObjectui64v = nullptr;
+
+static void LoadOptionalGLFunctions() {
+  // Some drivers hand out non-null pointers for anything, so only look a
+  // function up once the extension that provides it is known to be present.
+#define LOAD_GL_FUNC_WHEN(supported, name)                                     \
+  do {                                                                         \
+    p##name = (supported) ? reinterpret_cast<decltype(p##name)>(               \
+                                SDL_GL_GetProcAddress(#name))                  \
+                          : nullptr;                                           \
+  } while (0)
+
+#ifdef __EMSCRIPTEN__
+  const bool hasFramebuffers = true; // core in GLES2 / WebGL
+#else
+  const bool hasFramebuffers =
+      SDL_GL_ExtensionSupported("GL_ARB_framebuffer_object");
+  const bool hasTimerQueries = SDL_GL_ExtensionSupported("GL_ARB_timer_query");
+
+  LOAD_GL_FUNC_WHEN(true, glGenBuffers);
+  LOAD_GL_FUNC_WHEN(true, glDeleteBuffers);
+  LOAD_GL_FUNC_WHEN(true, glBindBuffer);
+  LOAD_GL_FUNC_WHEN(true, glBufferData);
+
+  const bool hasSync = SDL_GL_ExtensionSupported("GL_ARB_sync");
+  LOAD_GL_FUNC_WHEN(hasSync, glFenceSync);
+  LOAD_GL_FUNC_WHEN(hasSync, glClientWaitSync);
+  LOAD_GL_FUNC_WHEN(hasSync, glDeleteSync);
+
+  LOAD_GL_FUNC_WHEN(SDL_GL_ExtensionSupported("GL_ARB_texture_storage"),
+                    glTexStorage2D);
+
+  LOAD_GL_FUNC_WHEN(hasTimerQueries, glGenQueries);
+  LOAD_GL_FUNC_WHEN(hasTimerQueries, glDeleteQueries);
+  LOAD_GL_FUNC_WHEN(hasTimerQueries, glBeginQuery);
+  LOAD_GL_FUNC_WHEN(hasTimerQueries, glEndQuery);
+  LOAD_GL_FUNC_WHEN(hasTimerQueries, glGetQueryObjectiv);
+  LOAD_GL_FUNC_WHEN(hasTimerQueries, glGetQueryObjectui64v);
+#endif
+
+  LOAD_GL_FUNC_WHEN(hasFramebuffers, glGenFramebuffers);
+  LOAD_GL_FUNC_WHEN(hasFramebuffers, glDeleteFramebuffers);
+  LOAD_GL_FUNC_WHEN(hasFramebuffers, glBindFramebuffer);
+  LOAD_GL_FUNC_WHEN(hasFramebuffers, glFramebufferTexture2D);
+  LOAD_GL_FUNC_WHEN(hasFramebuffers, glCheckFramebufferStatus);
+  LOAD_GL_FUNC_WHEN(hasFramebuffers, glGenerateMipmap);
+
+#undef LOAD_GL_FUNC_WHEN
+}
+
+// ------------------- Deferred destruction -------------------
+
+// Deleting an object the GPU may still be reading (a texture drawn in a
+// frame that hasn't finished) makes some drivers stall or copy it behind our
+// back. Objects are instead retired with the number of the frame being
+// built, and deleted in one batch per kind once a fence placed at the start
+// of the next frame shows the GPU is past it. Without fences we assume no
+// more than kAssumedFramesInFlight frames are queued.
+//
+// Textures made by CreateTextureFromSurface can be recycled instead: once
+// safe, they wait a while for a request of the same size (AcquireTexture),
+// which respecifies them rather than allocating new ones.
+constexpr uint64_t kAssumedFramesInFlight = 3;
+constexpr size_t kMaxRecycledTextures = 16;
+constexpr uint64_t kRecycleKeepFrames = 120;
+
+static void Retire(GLRenderer &renderer, GLRetiredObject::Kind kind,
+                   GLuint id, int width = 0, int height = 0) {
+  if (id) {
+    renderer.retired.push_back({kind, id, width, height, renderer.frame});
+  }
+}
+
+// Deletes the texture once no in-flight frame can use it.
+void RetireTexture(GLRenderer &renderer, GLTexture &tex) {
+  Retire(renderer, GLRetiredObject::Kind::Texture, tex.id);
+  tex = {};
+}
+
+// Like RetireTexture, but offers it to AcquireTexture first. Only for
+// textures from CreateTextureFromSurface (mutable storage).
+void RecycleTexture(GLRenderer &renderer, GLTexture &tex) {
+  Retire(renderer, GLRetiredObject::Kind::RecycledTexture, tex.id, tex.width,
+         tex.height);
+  tex = {};
+}
+
+void RetireBuffer(GLRenderer &renderer, GLuint &buffer) {
+  Retire(renderer, GLRetiredObject::Kind::Buffer, buffer);
+  buffer = 0;
+}
+
+void RetireFramebuffer(GLRenderer &renderer, GLuint &fbo) {
+  Retire(renderer, GLRetiredObject::Kind::Framebuffer, fbo);
+  fbo = 0;
+}
+
+void RetireProgram(GLRenderer &renderer, GLuint &program) {
+  Retire(renderer, GLRetiredObject::Kind::Program, program);
+  program = 0;
+}
+
+// A recycled texture name of exactly this size, or 0 if there is none.
+GLuint AcquireTexture(GLRenderer &renderer, int width, int height) {
+  auto &recycled = renderer.recycled;
+  for (auto it = recycled.rbegin(); it != recycled.rend(); ++it) {
+    if (it->width == width && it->height == height) {
+      const GLuint id = it->id;
+      recycled.erase(std::next(it).base());
+      ++renderer.stats.texturesRecycled;
+      return id;
+    }
+  }
+  return 0;
+}
+
+// Marks the end of the frame just submitted and starts the next one. Called
+// by EndFrameInFlight.
+static void FenceFrame(GLRenderer &renderer) {
+#ifndef __EMSCRIPTEN__
+  if (pglFenceSync) {
+    renderer.frameFences.push_back(
+        {renderer.frame, pglFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0)});
+  }
+#endif
+  ++renderer.frame;
+}
+
+// Names due for deletion, gathered per kind so each kind is one GL call.
+struct GLDeleteBatch {
+  std::vector<GLuint> textures;
+  std::vector<GLuint> buffers;
+  std::vector<GLuint> framebuffers;
+  std::vector<GLuint> programs;
+};
+
+static void AddToDeleteBatch(GLDeleteBatch &batch,
+                             const GLRetiredObject &object) {
+  switch (object.kind) {
+  case GLRetiredObject::Kind::Texture:
+  case GLRetiredObject::Kind::RecycledTexture:
+    batch.textures.push_back(object.id);
+    break;
+  case GLRetiredObject::Kind::Buffer:
+    batch.buffers.push_back(object.id);
+    break;
+  case GLRetiredObject::Kind::Framebuffer:
+    batch.framebuffers.push_back(object.id);
+    break;
+  case GLRetiredObject::Kind::Program:
+    batch.programs.push_back(object.id);
+    break;
+  }
+}
+
+static void DeleteRetired(GLRenderer &renderer, GLDeleteBatch &batch) {
+  if (!batch.textures.empty()) {
+    glDeleteTextures(static_cast<GLsizei>(batch.textures.size()),
+                     batch.textures.data());
+  }
+  if (!batch.buffers.empty()) {
+    pglDeleteBuffers(static_cast<GLsizei>(batch.buffers.size()),
+                     batch.buffers.data());
+  }
+  if (!batch.framebuffers.empty()) {
+    pglDeleteFramebuffers(static_cast<GLsizei>(batch.framebuffers.size()),
+                          batch.framebuffers.data());
+  }
+#ifdef __EMSCRIPTEN__
+  // (only the GLES2 path has programs)
+  for (GLuint program : batch.programs) {
+    glDeleteProgram(program);
+  }
+#endif
+  renderer.stats.objectsDeleted += static_cast<int>(
+      batch.textures.size() + batch.buffers.size() +
+      batch.framebuffers.size() + batch.programs.size());
+  batch = {};
+}
+
+// True if completedFrame comes from fences rather than an assumption.
+bool HasFrameFences() {
+#ifdef __EMSCRIPTEN__
+  return false;
+#else
+  return pglFenceSync != nullptr;
+#endif
+}
+
+// Advances completedFrame past every frame whose fence has signalled.
+void PollFrameFences(GLRenderer &renderer) {
+  uint64_t &completed = renderer.completedFrame;
+  if (!HasFrameFences()) {
+    completed = renderer.frame > kAssumedFramesInFlight
+                    ? renderer.frame - kAssumedFramesInFlight
+                    : 0;
+    return;
+  }
+#ifndef __EMSCRIPTEN__
+  auto &fences = renderer.frameFences;
+  while (!fences.empty()) {
+    const GLenum status = pglClientWaitSync(fences.front().fence, 0, 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+      break;
+    }
+    completed = fences.front().frame;
+    pglDeleteSync(fences.front().fence);
+    fences.pop_front();
+  }
+#endif
+}
+
+// Deletes or recycles what the GPU has finished with. Called by BeginFrame.
+void CollectRetiredObjects(GLRenderer &renderer) {
+  PollFrameFences(renderer);
+  const uint64_t completed = renderer.completedFrame;
+
+  GLDeleteBatch batch;
+  auto &retired = renderer.retired;
+  auto done = std::stable_partition(
+      retired.begin(), retired.end(),
+      [completed](const GLRetiredObject &o) { return o.frame > completed; });
+  for (auto it = done; it != retired.end(); ++it) {
+    if (it->kind == GLRetiredObject::Kind::RecycledTexture) {
+      renderer.recycled.push_back(*it);
+      renderer.recycled.back().frame = renderer.frame;
+    } else {
+      AddToDeleteBatch(batch, *it);
+    }
+  }
+  retired.erase(done, retired.end());
+
+  // recycled textures nobody claimed in time, oldest first
+  auto &recycled = renderer.recycled;
+  size_t keep = 0;
+  for (size_t i = 0; i < recycled.size(); ++i) {
+    const bool stale =
+        recycled[i].frame + kRecycleKeepFrames < renderer.frame ||
+        recycled.size() - i > kMaxRecycledTextures;
+    if (stale) {
+      batch.textures.push_back(recycled[i].id);
+    } else {
+      recycled[keep++] = recycled[i];
+    }
+  }
+  recycled.resize(keep);
+
+  DeleteRetired(renderer, batch);
+}
+
+// Deletes everything still retired or recycled, waiting for the GPU first.
+static void DeleteAllRetiredObjects(GLRenderer &renderer) {
+  glFinish();
+  GLDeleteBatch batch;
+  for (const auto *list : {&renderer.retired, &renderer.recycled}) {
+    for (const GLRetiredObject &o : *list) {
+      AddToDeleteBatch(batch, o);
+    }
+  }
+  DeleteRetired(renderer, batch);
+  renderer.retired.clear();
+  renderer.recycled.clear();
+#ifndef __EMSCRIPTEN__
+  for (const GLFrameFence &f : renderer.frameFences) {
+    pglDeleteSync(f.fence);
+  }
+  renderer.frameFences.clear();
+#endif
+}
+
+// ------------------- GL renderer -------------------
+
 bool InitGL(SDL_Window *window, GLRenderer &out) {
   // Request a compatibility-ish profile for desktop.
   SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 2);
@@ -313,6 +785,8 @@ bool InitGL(SDL_Window *window, GLRenderer &out) {
   }
 #endif
 
+  LoadOptionalGLFunctions();
+
   // VSync
   SDL_GL_SetSwapInterval(1);
 
@@ -336,6 +810,20 @@ bool InitGL(SDL_Window *window, GLRenderer &out) {
   glEnable(GL_BLEND);
   glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
+  // untextured geometry samples this so it can share batches with sprites
+  const uint8_t whiteTexel[4] = {255, 255, 255, 255};
+  glGenTextures(1, &out.white.id);
+  glBindTexture(GL_TEXTURE_2D, out.white.id);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+               whiteTexel);
+  out.white.width = 1;
+  out.white.height = 1;
+
+  out.batch.vertices.reserve(kBatchMaxVertices);
+  out.batch.indices.reserve(kBatchMaxIndices);
+
 #ifdef __EMSCRIPTEN__
   // WebGL / GLES2 shader path (no legacy GL emulation).
   out.program = CreateTexturedQuadProgram();
@@ -349,15 +837,18 @@ bool InitGL(SDL_Window *window, GLRenderer &out) {
   out.uTextureLoc = pglGetUniformLocation(out.program, "uTexture");
   out.aPosLoc = pglGetAttribLocation(out.program, "aPos");
   out.aUVLoc = pglGetAttribLocation(out.program, "aUV");
+  out.aColorLoc = pglGetAttribLocation(out.program, "aColor");
+  out.uTranslateLoc = pglGetUniformLocation(out.program, "uTranslate");
 
   if (out.uResolutionLoc == -1 || out.uTextureLoc == -1 || out.aPosLoc == -1 ||
-      out.aUVLoc == -1) {
+      out.aUVLoc == -1 || out.aColorLoc == -1 || out.uTranslateLoc == -1) {
     SDL_LogError(SDL_LOG_CATEGORY_CUSTOM, "Failed to get shader locations");
     return false;
   }
 
   pglGenBuffers(1, &out.vbo);
-  if (!out.vbo) {
+  pglGenBuffers(1, &out.ibo);
+  if (!out.vbo || !out.ibo) {
     SDL_LogError(SDL_LOG_CATEGORY_CUSTOM, "glGenBuffers failed");
     return false;
   }
@@ -373,17 +864,16 @@ bool InitGL(SDL_Window *window, GLRenderer &out) {
   return true;
 }
 
+// Deletes the renderer's own objects along with everything retired, once
+// the GPU is done with all of them.
 void ShutdownGL(SDL_Window *window, GLRenderer &renderer) {
+  RetireTexture(renderer, renderer.white);
 #ifdef __EMSCRIPTEN__
-  if (renderer.vbo) {
-    pglDeleteBuffers(1, &renderer.vbo);
-    renderer.vbo = 0;
-  }
-  if (renderer.program) {
-    glDeleteProgram(renderer.program);
-    renderer.program = 0;
-  }
+  RetireBuffer(renderer, renderer.vbo);
+  RetireBuffer(renderer, renderer.ibo);
+  RetireProgram(renderer, renderer.program);
 #endif
+  DeleteAllRetiredObjects(renderer);
 
   if (renderer.context) {
     SDL_GL_MakeCurrent(window, nullptr);
@@ -392,247 +882,5770 @@ void ShutdownGL(SDL_Window *window, GLRenderer &renderer) {
   }
 }
 
-GLTexture CreateTextureFromSurface(SDL_Surface *surface) {
-  GLTexture tex;
-  if (!surface) {
-    return tex;
-  }
-
-  // Convert to RGBA32 so we know what we're uploading
-  SDL_Surface *rgba = SDL_ConvertSurface(surface, SDL_PIXELFORMAT_RGBA32);
-  if (!rgba) {
-    SDL_LogError(SDL_LOG_CATEGORY_CUSTOM, "SDL_ConvertSurfaceFormat failed: %s",
-                 SDL_GetError());
-    return tex;
-  }
-
-  glGenTextures(1, &tex.id);
-  glBindTexture(GL_TEXTURE_2D, tex.id);
-
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-  tex.width = rgba->w;
-  tex.height = rgba->h;
-
-  GLint prevAlign = 0;
-  glGetIntegerv(GL_UNPACK_ALIGNMENT, &prevAlign);
-  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, rgba->w, rgba->h, 0, GL_RGBA,
-               GL_UNSIGNED_BYTE, rgba->pixels);
+// ------------------- Late latching -------------------
 
-  glPixelStorei(GL_UNPACK_ALIGNMENT, prevAlign);
+// Geometry that follows the pointer (a cursor, a dragged handle) is built from
+// where the pointer was when the frame started, and everything else is drawn
+// before it reaches GL. Drawing it between BeginLateLatch and EndLateLatch
+// lets FlushBatch move those vertices to the newest pointer position right
+// before submitting them, without rebuilding anything.
 
-  SDL_DestroySurface(rgba);
+void SetLateLatchSampler(GLRenderer &renderer, GLLatchSampler sampler,
+                         void *userdata) {
+  renderer.latchSampler = sampler;
+  renderer.latchUserdata = userdata;
+}
 
-  return tex;
+// `x`, `y`: the pointer position the following draws are built for.
+void BeginLateLatch(GLRenderer &renderer, float x, float y) {
+  renderer.latches.push_back({renderer.batch.vertices.size(), SIZE_MAX, x, y});
 }
 
-void DestroyTexture(GLTexture &tex) {
-  if (tex.id) {
-    glDeleteTextures(1, &tex.id);
-    tex.id = 0;
+void EndLateLatch(GLRenderer &renderer) {
+  if (!renderer.latches.empty() && renderer.latches.back().end == SIZE_MAX) {
+    renderer.latches.back().end = renderer.batch.vertices.size();
   }
 }
 
-void BeginFrame(GLRenderer &renderer, SDL_Window *window, float r, float g,
-                float b) {
-  int w, h;
-  SDL_GetWindowSizeInPixels(window, &w, &h);
-
-  glViewport(0, 0, w, h);
+// Called by FlushBatch: shifts the latched vertices by how far the pointer
+// has moved since they were built. A latch still being drawn carries on into
+// the next batch.
+static void ApplyLateLatches(GLRenderer &renderer) {
+  if (renderer.latches.empty()) {
+    return;
+  }
 
-#ifndef __EMSCRIPTEN__
-  glMatrixMode(GL_PROJECTION);
-  glLoadIdentity();
-  glOrtho(0, w, h, 0, -1, 1); // origin top-left
-  glMatrixMode(GL_MODELVIEW);
-  glLoadIdentity();
-#else
-  pglUseProgram(renderer.program);
-  pglUniform2f(renderer.uResolutionLoc, static_cast<float>(w),
-               static_cast<float>(h));
-#endif
+  std::vector<GLVertex> &vertices = renderer.batch.vertices;
+  float x, y;
+  if (!vertices.empty() && renderer.latchSampler &&
+      renderer.latchSampler(renderer.latchUserdata, &x, &y)) {
+    for (const GLLateLatch &latch : renderer.latches) {
+      const float dx = x - latch.x;
+      const float dy = y - latch.y;
+      const size_t end = std::min(latch.end, vertices.size());
+      for (size_t i = latch.first; i < end; ++i) {
+        vertices[i].x += dx;
+        vertices[i].y += dy;
+      }
+      renderer.stats.latchShift =
+          std::max(renderer.stats.latchShift, std::sqrt(dx * dx + dy * dy));
+    }
+  }
 
-  glClearColor(r, g, b, 1.0f);
-  glClear(GL_COLOR_BUFFER_BIT);
+  GLLateLatch open = renderer.latches.back();
+  renderer.latches.clear();
+  if (open.end == SIZE_MAX) {
+    open.first = 0;
+    renderer.latches.push_back(open);
+  }
 }
 
-void DrawTexture(GLRenderer &renderer, const GLTexture &tex, float x, float y,
-                 float w, float h) {
-  if (!tex.id) {
+// ------------------- Geometry batching -------------------
+
+// Everything is drawn as indexed triangles from one vertex stream. Draws are
+// appended to renderer.batch and submitted together when the texture changes
+// or the batch fills up, so runs of sprites and shapes sharing a texture cost
+// one draw call. Code about to change GL state the queued draws depend on
+// (target, viewport, blending, texture contents) must call FlushBatch first.
+
+void FlushBatch(GLRenderer &renderer) {
+  GLBatch &batch = renderer.batch;
+  if (batch.indices.empty()) {
+    batch.vertices.clear();
+    ApplyLateLatches(renderer);
     return;
   }
 
-#ifdef __EMSCRIPTEN__
-  struct Vertex {
-    float x, y;
-    float u, v;
-  };
-
-  // Two triangles forming the quad.
-  Vertex verts[6] = {
-      // 1st triangle
-      {x, y, 0.0f, 0.0f},
-      {x + w, y, 1.0f, 0.0f},
-      {x + w, y + h, 1.0f, 1.0f},
-      // 2nd triangle
-      {x, y, 0.0f, 0.0f},
-      {x + w, y + h, 1.0f, 1.0f},
-      {x, y + h, 0.0f, 1.0f},
-  };
+  ApplyLateLatches(renderer);
+  const GLVertex *v = batch.vertices.data();
+  const auto indexCount = static_cast<GLsizei>(batch.indices.size());
 
+#ifdef __EMSCRIPTEN__
   pglUseProgram(renderer.program);
 
   pglActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_2D, tex.id);
+  glBindTexture(GL_TEXTURE_2D, batch.texture);
 
+  // Respecifying the whole store lets the driver hand out fresh memory
+  // instead of waiting for earlier draws that still read the old contents.
   pglBindBuffer(GL_ARRAY_BUFFER, renderer.vbo);
-  pglBufferData(GL_ARRAY_BUFFER, static_cast<std::intptr_t>(sizeof(verts)),
-                verts, GL_DYNAMIC_DRAW);
+  pglBufferData(GL_ARRAY_BUFFER,
+                static_cast<std::intptr_t>(batch.vertices.size() *
+                                           sizeof(GLVertex)),
+                v, GL_STREAM_DRAW);
+  pglBindBuffer(GL_ELEMENT_ARRAY_BUFFER, renderer.ibo);
+  pglBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                static_cast<std::intptr_t>(indexCount * sizeof(uint16_t)),
+                batch.indices.data(), GL_STREAM_DRAW);
 
   pglEnableVertexAttribArray(renderer.aPosLoc);
-  pglVertexAttribPointer(renderer.aPosLoc, 2, GL_FLOAT, GL_FALSE,
-                         sizeof(Vertex), reinterpret_cast<const void *>(0));
+  pglVertexAttribPointer(
+      renderer.aPosLoc, 2, GL_FLOAT, GL_FALSE, sizeof(GLVertex),
+      reinterpret_cast<const void *>(offsetof(GLVertex, x)));
 
   pglEnableVertexAttribArray(renderer.aUVLoc);
-  pglVertexAttribPointer(renderer.aUVLoc, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-                         reinterpret_cast<const void *>(2 * sizeof(float)));
+  pglVertexAttribPointer(
+      renderer.aUVLoc, 2, GL_FLOAT, GL_FALSE, sizeof(GLVertex),
+      reinterpret_cast<const void *>(offsetof(GLVertex, u)));
 
-  pglDrawArrays(GL_TRIANGLES, 0, 6);
+  pglEnableVertexAttribArray(renderer.aColorLoc);
+  pglVertexAttribPointer(
+      renderer.aColorLoc, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(GLVertex),
+      reinterpret_cast<const void *>(offsetof(GLVertex, color)));
+
+  pglDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_SHORT, nullptr);
 
   pglDisableVertexAttribArray(renderer.aPosLoc);
   pglDisableVertexAttribArray(renderer.aUVLoc);
+  pglDisableVertexAttribArray(renderer.aColorLoc);
 #else
-  glBindTexture(GL_TEXTURE_2D, tex.id);
-
-  glBegin(GL_TRIANGLES);
-  // 1st triangle
-  glTexCoord2f(0.f, 0.f);
-  glVertex2f(x, y);
-  glTexCoord2f(1.f, 0.f);
-  glVertex2f(x + w, y);
-  glTexCoord2f(1.f, 1.f);
-  glVertex2f(x + w, y + h);
-  // 2nd triangle
-  glTexCoord2f(0.f, 0.f);
-  glVertex2f(x, y);
-  glTexCoord2f(1.f, 1.f);
-  glVertex2f(x + w, y + h);
-  glTexCoord2f(0.f, 1.f);
-  glVertex2f(x, y + h);
-  glEnd();
+  // Client-side arrays: the driver copies them into its own streaming
+  // storage at draw time, which GL 2.1 gives us without loading anything.
+  glBindTexture(GL_TEXTURE_2D, batch.texture);
+
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+  glEnableClientState(GL_COLOR_ARRAY);
+  glVertexPointer(2, GL_FLOAT, sizeof(GLVertex), &v->x);
+  glTexCoordPointer(2, GL_FLOAT, sizeof(GLVertex), &v->u);
+  glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(GLVertex), &v->color);
+
+  glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_SHORT,
+                 batch.indices.data());
+
+  glDisableClientState(GL_VERTEX_ARRAY);
+  glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+  glDisableClientState(GL_COLOR_ARRAY);
+  // the current colour is undefined after drawing with a colour array
+  glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
 #endif
+
+  ++renderer.stats.drawCalls;
+  renderer.stats.batchedVertices += static_cast<int>(batch.vertices.size());
+  batch.vertices.clear();
+  batch.indices.clear();
 }
 
-void EndFrame(SDL_Window *window) { SDL_GL_SwapWindow(window); }
+// Makes room for a draw using `texture`, flushing if it can't join the
+// current batch, and returns the index its first vertex will get.
+static uint16_t ReserveBatch(GLRenderer &renderer, GLuint texture,
+                             int vertexCount, int indexCount) {
+  GLBatch &batch = renderer.batch;
+  if (batch.texture != texture ||
+      batch.vertices.size() + vertexCount > kBatchMaxVertices ||
+      batch.indices.size() + indexCount > kBatchMaxIndices) {
+    FlushBatch(renderer);
+    batch.texture = texture;
+  }
+  return static_cast<uint16_t>(batch.vertices.size());
+}
 
-// ------------------- App state -------------------
+static void PushQuadIndices(GLBatch &batch, uint16_t first) {
+  // first..first+3 go around the quad
+  batch.indices.insert(batch.indices.end(),
+                       {first, static_cast<uint16_t>(first + 1),
+                        static_cast<uint16_t>(first + 2), first,
+                        static_cast<uint16_t>(first + 2),
+                        static_cast<uint16_t>(first + 3)});
+}
 
-struct AppContext {
-  SDL_Window *window = nullptr;
-  GLRenderer gl;
-  GLTexture messageTex;
-  GLTexture imageTex;
-  SDL_FRect messageDest{};
-  MIX_Track *track = nullptr;
-  SDL_AppResult app_quit = SDL_APP_CONTINUE;
-};
+// Draws a triangle list. `indices` refer to `vertices`; pass nullptr to use
+// the vertices in order. `tex` may be nullptr for untextured geometry. One
+// call can use at most kBatchMaxVertices vertices.
+void DrawGeometry(GLRenderer &renderer, const GLTexture *tex,
+                  const GLVertex *vertices, int vertexCount,
+                  const uint16_t *indices = nullptr, int indexCount = 0) {
+  if (!indices) {
+    indexCount = vertexCount;
+  }
+  if (vertexCount <= 0 || indexCount <= 0) {
+    return;
+  }
+  if (vertexCount > kBatchMaxVertices || indexCount > kBatchMaxIndices) {
+    SDL_LogError(SDL_LOG_CATEGORY_CUSTOM,
+                 "Geometry too large for one batch (%d vertices, %d indices)",
+                 vertexCount, indexCount);
+    return;
+  }
 
-// ------------------- SDL callbacks -------------------
+  const GLuint texture = tex && tex->id ? tex->id : renderer.white.id;
+  const uint16_t base = ReserveBatch(renderer, texture, vertexCount, indexCount);
 
-SDL_AppResult SDL_AppInit(void **appstate, int argc, char *argv[]) {
-  (void)argc;
-  (void)argv;
+  GLBatch &batch = renderer.batch;
+  batch.vertices.insert(batch.vertices.end(), vertices,
+                        vertices + vertexCount);
+  for (int i = 0; i < indexCount; ++i) {
+    batch.indices.push_back(
+        static_cast<uint16_t>(base + (indices ? indices[i] : i)));
+  }
+}
 
-  // init the library
-  if (!SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO)) {
-    return SDL_Fail();
+void FillRect(GLRenderer &renderer, const SDL_FRect &rect, SDL_Color color) {
+  const uint16_t base = ReserveBatch(renderer, renderer.white.id, 4, 6);
+  const float x1 = rect.x + rect.w;
+  const float y1 = rect.y + rect.h;
+  renderer.batch.vertices.insert(renderer.batch.vertices.end(),
+                                 {{rect.x, rect.y, 0.0f, 0.0f, color},
+                                  {x1, rect.y, 0.0f, 0.0f, color},
+                                  {x1, y1, 0.0f, 0.0f, color},
+                                  {rect.x, y1, 0.0f, 0.0f, color}});
+  PushQuadIndices(renderer.batch, base);
+}
+
+// Outline drawn inside `rect`.
+void DrawRect(GLRenderer &renderer, const SDL_FRect &rect, float thickness,
+              SDL_Color color) {
+  const float t = std::min({thickness, rect.w * 0.5f, rect.h * 0.5f});
+  const float outer[4][2] = {{rect.x, rect.y},
+                             {rect.x + rect.w, rect.y},
+                             {rect.x + rect.w, rect.y + rect.h},
+                             {rect.x, rect.y + rect.h}};
+  const float inset[4][2] = {{t, t}, {-t, t}, {-t, -t}, {t, -t}};
+
+  const uint16_t base = ReserveBatch(renderer, renderer.white.id, 8, 24);
+  GLBatch &batch = renderer.batch;
+  for (int i = 0; i < 4; ++i) {
+    batch.vertices.push_back({outer[i][0], outer[i][1], 0.0f, 0.0f, color});
+    batch.vertices.push_back({outer[i][0] + inset[i][0],
+                              outer[i][1] + inset[i][1], 0.0f, 0.0f, color});
+  }
+  // one quad per side: outer i, outer i+1, inner i+1, inner i
+  for (int i = 0; i < 4; ++i) {
+    const auto o0 = static_cast<uint16_t>(base + 2 * i);
+    const auto o1 = static_cast<uint16_t>(base + 2 * ((i + 1) % 4));
+    batch.indices.insert(batch.indices.end(),
+                         {o0, o1, static_cast<uint16_t>(o1 + 1), o0,
+                          static_cast<uint16_t>(o1 + 1),
+                          static_cast<uint16_t>(o0 + 1)});
   }
+}
 
-  // init TTF
-  if (!TTF_Init()) {
-    return SDL_Fail();
+void DrawLine(GLRenderer &renderer, float x0, float y0, float x1, float y1,
+              float thickness, SDL_Color color) {
+  const float dx = x1 - x0;
+  const float dy = y1 - y0;
+  const float length = std::sqrt(dx * dx + dy * dy);
+  if (length <= 0.0f) {
+    return;
   }
+  // half-thickness normal
+  const float nx = -dy / length * thickness * 0.5f;
+  const float ny = dx / length * thickness * 0.5f;
+
+  const uint16_t base = ReserveBatch(renderer, renderer.white.id, 4, 6);
+  renderer.batch.vertices.insert(renderer.batch.vertices.end(),
+                                 {{x0 + nx, y0 + ny, 0.0f, 0.0f, color},
+                                  {x1 + nx, y1 + ny, 0.0f, 0.0f, color},
+                                  {x1 - nx, y1 - ny, 0.0f, 0.0f, color},
+                                  {x0 - nx, y0 - ny, 0.0f, 0.0f, color}});
+  PushQuadIndices(renderer.batch, base);
+}
 
-  // init Mixer
-  if (!MIX_Init()) {
-    return SDL_Fail();
+// Enough segments that the chords stay within a quarter pixel of the circle.
+static int CircleSegments(float radius) {
+  if (radius <= 0.25f) {
+    return 8;
   }
+  const float step = 2.0f * std::acos(1.0f - 0.25f / radius);
+  return std::clamp(static_cast<int>(std::ceil(2.0f * SDL_PI_F / step)), 8,
+                    1024);
+}
 
-  // create a window (with OpenGL)
-  SDL_Window *window = SDL_CreateWindow(
-      "SDL Minimal Sample (OpenGL)", windowStartWidth, windowStartHeight,
-      SDL_WINDOW_RESIZABLE | SDL_WINDOW_HIGH_PIXEL_DENSITY | SDL_WINDOW_OPENGL);
-  if (!window) {
-    return SDL_Fail();
+// Calls emit(x, y) for `segments` points around the unit circle by rotating
+// one vector, avoiding a sin/cos pair per point.
+template <typename Emit> static void ForEachCirclePoint(int segments, Emit emit) {
+  const float step = 2.0f * SDL_PI_F / segments;
+  const float c = std::cos(step);
+  const float s = std::sin(step);
+  float x = 1.0f;
+  float y = 0.0f;
+  for (int i = 0; i < segments; ++i) {
+    emit(x, y);
+    const float nx = x * c - y * s;
+    y = x * s + y * c;
+    x = nx;
   }
+}
 
-  // init our OpenGL renderer
-  GLRenderer glRenderer;
-  if (!InitGL(window, glRenderer)) {
-    return SDL_Fail();
+void FillCircle(GLRenderer &renderer, float cx, float cy, float radius,
+                SDL_Color color) {
+  const int n = CircleSegments(radius);
+  const uint16_t base = ReserveBatch(renderer, renderer.white.id, n + 1, 3 * n);
+  GLBatch &batch = renderer.batch;
+
+  batch.vertices.push_back({cx, cy, 0.0f, 0.0f, color});
+  ForEachCirclePoint(n, [&](float x, float y) {
+    batch.vertices.push_back(
+        {cx + x * radius, cy + y * radius, 0.0f, 0.0f, color});
+  });
+  for (int i = 0; i < n; ++i) {
+    batch.indices.insert(batch.indices.end(),
+                         {base, static_cast<uint16_t>(base + 1 + i),
+                          static_cast<uint16_t>(base + 1 + (i + 1) % n)});
   }
+}
 
-  // load the font
-#if __ANDROID__
-  std::filesystem::path basePath = "assets";
-#else
-  auto basePathPtr = SDL_GetBasePath();
-  if (!basePathPtr) {
-    return SDL_Fail();
+// Ring whose outer edge is at `radius`.
+void DrawCircle(GLRenderer &renderer, float cx, float cy, float radius,
+                float thickness, SDL_Color color) {
+  const int n = CircleSegments(radius);
+  const float inner = std::max(0.0f, radius - thickness);
+  const uint16_t base =
+      ReserveBatch(renderer, renderer.white.id, 2 * n, 6 * n);
+  GLBatch &batch = renderer.batch;
+
+  ForEachCirclePoint(n, [&](float x, float y) {
+    batch.vertices.push_back(
+        {cx + x * radius, cy + y * radius, 0.0f, 0.0f, color});
+    batch.vertices.push_back(
+        {cx + x * inner, cy + y * inner, 0.0f, 0.0f, color});
+  });
+  for (int i = 0; i < n; ++i) {
+    const auto o0 = static_cast<uint16_t>(base + 2 * i);
+    const auto o1 = static_cast<uint16_t>(base + 2 * ((i + 1) % n));
+    batch.indices.insert(batch.indices.end(),
+                         {o0, o1, static_cast<uint16_t>(o1 + 1), o0,
+                          static_cast<uint16_t>(o1 + 1),
+                          static_cast<uint16_t>(o0 + 1)});
   }
-  const std::filesystem::path basePath = basePathPtr;
-#endif
+}
 
-  const auto fontPath = basePath / "assets/Inter-VariableFont.ttf";
-  TTF_Font *font = TTF_OpenFont(fontPath.string().c_str(), 36);
-  if (!font) {
-    return SDL_Fail();
+// Fills a convex polygon given its corners in order (either winding).
+void FillConvexPolygon(GLRenderer &renderer, const SDL_FPoint *points,
+                       int count, SDL_Color color) {
+  if (count < 3 || count > kBatchMaxVertices) {
+    return;
+  }
+  const uint16_t base =
+      ReserveBatch(renderer, renderer.white.id, count, 3 * (count - 2));
+  GLBatch &batch = renderer.batch;
+
+  for (int i = 0; i < count; ++i) {
+    batch.vertices.push_back({points[i].x, points[i].y, 0.0f, 0.0f, color});
+  }
+  for (int i = 1; i + 1 < count; ++i) {
+    batch.indices.insert(batch.indices.end(),
+                         {base, static_cast<uint16_t>(base + i),
+                          static_cast<uint16_t>(base + i + 1)});
+  }
+}
+
+// ------------------- Mipmaps -------------------
+
+// One downsampled level of a texture, tightly packed RGBA32.
+struct MipLevel {
+  int width = 0;
+  int height = 0;
+  std::vector<uint8_t> pixels;
+};
+
+// Levels 1..N of a texture; level 0 is the image itself.
+using MipChain = std::vector<MipLevel>;
+
+enum class TextureMips {
+  None,     // level 0 only, bilinear filtering
+  Generate, // full chain, trilinear filtering
+};
+
+static bool CanMipmap(int width, int height) {
+#ifdef __EMSCRIPTEN__
+  // GLES2 / WebGL1 only mipmaps power-of-two textures.
+  return (width & (width - 1)) == 0 && (height & (height - 1)) == 0;
+#else
+  (void)width;
+  (void)height;
+  return true;
+#endif
+}
+
+// 2x2 box filter of an RGBA32 image into one of half the size (rounded down,
+// minimum 1). The last row/column of odd-sized images is reused.
+static void DownsampleBox(const uint8_t *src, int srcPitch, int srcW, int srcH,
+                          MipLevel &dst) {
+  for (int y = 0; y < dst.height; ++y) {
+    const uint8_t *row0 = src + (2 * y) * srcPitch;
+    const uint8_t *row1 = src + std::min(2 * y + 1, srcH - 1) * srcPitch;
+    uint8_t *out = dst.pixels.data() + static_cast<size_t>(y) * dst.width * 4;
+
+    int x = 0;
+#ifdef USE_SSE2
+    // 8 source pixels -> 4 destination pixels per step. Averaging rows then
+    // columns with pavgb rounds up twice, which is invisible in a mip level.
+    for (; 2 * (x + 4) <= srcW; x += 4) {
+      const auto *a = reinterpret_cast<const __m128i *>(row0 + 8 * x);
+      const auto *b = reinterpret_cast<const __m128i *>(row1 + 8 * x);
+      const __m128 v0 = _mm_castsi128_ps(
+          _mm_avg_epu8(_mm_loadu_si128(a), _mm_loadu_si128(b)));
+      const __m128 v1 = _mm_castsi128_ps(
+          _mm_avg_epu8(_mm_loadu_si128(a + 1), _mm_loadu_si128(b + 1)));
+      const __m128i even =
+          _mm_castps_si128(_mm_shuffle_ps(v0, v1, _MM_SHUFFLE(2, 0, 2, 0)));
+      const __m128i odd =
+          _mm_castps_si128(_mm_shuffle_ps(v0, v1, _MM_SHUFFLE(3, 1, 3, 1)));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 4 * x),
+                       _mm_avg_epu8(even, odd));
+    }
+#endif
+    for (; x < dst.width; ++x) {
+      const int x0 = 2 * x * 4;
+      const int x1 = std::min(2 * x + 1, srcW - 1) * 4;
+      for (int c = 0; c < 4; ++c) {
+        const int sum = row0[x0 + c] + row0[x1 + c] + row1[x0 + c] +
+                        row1[x1 + c];
+        out[4 * x + c] = static_cast<uint8_t>((sum + 2) / 4);
+      }
+    }
+  }
+}
+
+// Builds the mip chain of an RGBA32 surface on the CPU. Touches no GL state,
+// so it can run on a worker thread.
+MipChain BuildMipChain(const SDL_Surface *rgba) {
+  MipChain chain;
+  const uint8_t *src = static_cast<const uint8_t *>(rgba->pixels);
+  int srcPitch = rgba->pitch;
+  int w = rgba->w;
+  int h = rgba->h;
+
+  while (w > 1 || h > 1) {
+    MipLevel level;
+    level.width = std::max(1, w / 2);
+    level.height = std::max(1, h / 2);
+    level.pixels.resize(static_cast<size_t>(level.width) * level.height * 4);
+    DownsampleBox(src, srcPitch, w, h, level);
+
+    chain.push_back(std::move(level));
+    const MipLevel &last = chain.back();
+    src = last.pixels.data();
+    srcPitch = last.width * 4;
+    w = last.width;
+    h = last.height;
+  }
+
+  return chain;
+}
+
+// Creates a texture from any surface. With TextureMips::Generate the chain is
+// built by the GPU where possible, otherwise from `prebuilt` (e.g. computed
+// on a worker with BuildMipChain) or on the CPU right here. A non-zero
+// `reuse` (from AcquireTexture) is respecified instead of a new texture.
+GLTexture CreateTextureFromSurface(SDL_Surface *surface,
+                                   TextureMips mips = TextureMips::None,
+                                   const MipChain *prebuilt = nullptr,
+                                   GLuint reuse = 0) {
+  GLTexture tex;
+  if (!surface) {
+    return tex;
+  }
+
+  // Convert to RGBA32 so we know what we're uploading. Packed RGBA32 is
+  // uploaded as-is; padded rows (e.g. SDL_CreateSurfaceFrom) get a packed
+  // copy, since the upload assumes rows of exactly w * 4 bytes.
+  const bool packed = surface->format == SDL_PIXELFORMAT_RGBA32 &&
+                      surface->pitch == surface->w * 4;
+  SDL_Surface *rgba =
+      packed ? surface : SDL_ConvertSurface(surface, SDL_PIXELFORMAT_RGBA32);
+  if (!rgba) {
+    SDL_LogError(SDL_LOG_CATEGORY_CUSTOM, "SDL_ConvertSurfaceFormat failed: %s",
+                 SDL_GetError());
+    if (reuse) {
+      glDeleteTextures(1, &reuse); // the caller gave it up to us
+    }
+    return tex;
+  }
+
+  tex.id = reuse;
+  if (!tex.id) {
+    glGenTextures(1, &tex.id);
+  }
+  glBindTexture(GL_TEXTURE_2D, tex.id);
+
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+  tex.width = rgba->w;
+  tex.height = rgba->h;
+
+  GLint prevAlign = 0;
+  glGetIntegerv(GL_UNPACK_ALIGNMENT, &prevAlign);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, rgba->w, rgba->h, 0, GL_RGBA,
+               GL_UNSIGNED_BYTE, rgba->pixels);
+
+  if (mips == TextureMips::Generate && CanMipmap(rgba->w, rgba->h)) {
+    if (prebuilt && !prebuilt->empty()) {
+      for (size_t i = 0; i < prebuilt->size(); ++i) {
+        const MipLevel &level = (*prebuilt)[i];
+        glTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(i + 1), GL_RGBA,
+                     level.width, level.height, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                     level.pixels.data());
+      }
+    } else if (pglGenerateMipmap) {
+      pglGenerateMipmap(GL_TEXTURE_2D);
+    } else {
+      const MipChain chain = BuildMipChain(rgba);
+      for (size_t i = 0; i < chain.size(); ++i) {
+        glTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(i + 1), GL_RGBA,
+                     chain[i].width, chain[i].height, 0, GL_RGBA,
+                     GL_UNSIGNED_BYTE, chain[i].pixels.data());
+      }
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                    GL_LINEAR_MIPMAP_LINEAR);
+  }
+
+  glPixelStorei(GL_UNPACK_ALIGNMENT, prevAlign);
+
+  if (rgba != surface) {
+    SDL_DestroySurface(rgba);
+  }
+
+  return tex;
+}
+
+// ------------------- Image cache -------------------
+
+// Inflating a large PNG takes far longer than reading its pixels back. The
+// first decode of an image stores its RGBA32 pixels in a cache directory,
+// named after a hash of the source file and the SDL_image version that
+// decoded it. Later runs map that file and upload straight from the mapping.
+// Entries carry a checksum of their pixels, and the directory is trimmed to
+// kImageCacheBytes, least recently used first.
+
+constexpr uint32_t kImageCacheMagic = 0x41424752; // "RGBA" in the file
+constexpr uint32_t kImageCacheFormat = 1;
+constexpr uint64_t kImageCacheBytes = 64ull << 20;
+
+struct ImageCacheHeader {
+  uint32_t magic = kImageCacheMagic;
+  uint32_t format = kImageCacheFormat;
+  int32_t imageVersion = 0; // IMG_Version() that decoded the pixels
+  int32_t width = 0;
+  int32_t height = 0;
+  uint32_t reserved = 0;
+  uint64_t sourceHash = 0;
+  uint64_t pixelHash = 0; // of the width * height * 4 bytes that follow
+};
+
+// The whole file, memory-mapped where the platform allows and read into
+// memory otherwise (or if mapping fails, e.g. for Android assets).
+static std::shared_ptr<void> MapFile(const std::string &path, size_t &size) {
+#if USE_MMAP
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd >= 0) {
+    struct stat st{};
+    void *data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+      data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ,
+                  MAP_PRIVATE, fd, 0);
+    }
+    close(fd); // the mapping keeps the file open
+    if (data != MAP_FAILED) {
+      size = static_cast<size_t>(st.st_size);
+      return {data, [size](void *p) { munmap(p, size); }};
+    }
+  }
+#endif
+  void *data = SDL_LoadFile(path.c_str(), &size);
+  if (!data) {
+    return nullptr;
+  }
+  return {data, SDL_free};
+}
+
+static std::string ImageCachePath(const std::string &cacheDir,
+                                  const std::string &sourcePath,
+                                  uint64_t sourceHash) {
+  char file[256];
+  SDL_snprintf(file, sizeof(file), "%s-%016llx-%d.rgba",
+               std::filesystem::path(sourcePath).stem().string().c_str(),
+               static_cast<unsigned long long>(sourceHash), IMG_Version());
+  return cacheDir + file;
+}
+
+// A surface over the cached pixels, which `storage` keeps alive, or nullptr
+// on a miss. Entries that fail the checks are deleted.
+static SDL_Surface *ReadCachedImage(const std::string &path,
+                                    uint64_t sourceHash,
+                                    std::shared_ptr<void> &storage) {
+  size_t size = 0;
+  std::shared_ptr<void> file = MapFile(path, size);
+  if (!file) {
+    return nullptr;
+  }
+
+  ImageCacheHeader header;
+  const auto *bytes = static_cast<const uint8_t *>(file.get());
+  bool valid = size >= sizeof(header);
+  if (valid) {
+    std::memcpy(&header, bytes, sizeof(header));
+    const uint64_t pixelBytes = static_cast<uint64_t>(header.width) *
+                                static_cast<uint64_t>(header.height) * 4;
+    valid = header.magic == kImageCacheMagic &&
+            header.format == kImageCacheFormat &&
+            header.imageVersion == IMG_Version() &&
+            header.sourceHash == sourceHash && header.width > 0 &&
+            header.height > 0 && size - sizeof(header) == pixelBytes &&
+            HashBytes(0xCBF29CE484222325ull, bytes + sizeof(header),
+                      pixelBytes) == header.pixelHash;
+  }
+  if (!valid) {
+    SDL_LogWarn(SDL_LOG_CATEGORY_CUSTOM, "Discarding corrupt cache entry %s",
+                path.c_str());
+    file.reset();
+    SDL_RemovePath(path.c_str());
+    return nullptr;
+  }
+
+  SDL_Surface *surface = SDL_CreateSurfaceFrom(
+      header.width, header.height, SDL_PIXELFORMAT_RGBA32,
+      const_cast<uint8_t *>(bytes + sizeof(header)), header.width * 4);
+  if (!surface) {
+    return nullptr;
+  }
+  storage = std::move(file);
+
+  // mark it recently used for TrimImageCache
+  std::error_code ec;
+  std::filesystem::last_write_time(
+      path, std::filesystem::file_time_type::clock::now(), ec);
+  return surface;
+}
+
+// Deletes the least recently used entries until the cache fits `budget`.
+// Also used for the SVG raster cache.
+static void TrimImageCache(const std::string &cacheDir, uint64_t budget) {
+  struct Entry {
+    std::filesystem::path path;
+    std::filesystem::file_time_type used;
+    uint64_t size = 0;
+  };
+  std::vector<Entry> entries;
+  uint64_t total = 0;
+  std::error_code ec;
+  for (const auto &item : std::filesystem::directory_iterator(cacheDir, ec)) {
+    if (item.is_regular_file(ec)) {
+      const uint64_t size = item.file_size(ec);
+      entries.push_back({item.path(), item.last_write_time(ec), size});
+      total += size;
+    }
+  }
+  if (total <= budget) {
+    return;
+  }
+
+  std::sort(entries.begin(), entries.end(),
+            [](const Entry &a, const Entry &b) { return a.used < b.used; });
+  for (const Entry &entry : entries) {
+    if (total <= budget) {
+      break;
+    }
+    if (std::filesystem::remove(entry.path, ec)) {
+      total -= entry.size;
+    }
+  }
+}
+
+// Stores a decoded RGBA32 surface. Written to a temporary name first, so
+// that a reader never sees a partial entry.
+static void WriteCachedImage(const std::string &cacheDir,
+                             const std::string &path, uint64_t sourceHash,
+                             SDL_Surface *surface) {
+  ImageCacheHeader header;
+  header.imageVersion = IMG_Version();
+  header.width = surface->w;
+  header.height = surface->h;
+  header.sourceHash = sourceHash;
+  const size_t rowBytes = static_cast<size_t>(surface->w) * 4;
+  uint64_t hash = 0xCBF29CE484222325ull;
+  for (int y = 0; y < surface->h; ++y) {
+    hash = HashBytes(hash,
+                     static_cast<const uint8_t *>(surface->pixels) +
+                         static_cast<size_t>(y) * surface->pitch,
+                     rowBytes);
+  }
+  header.pixelHash = hash;
+
+  const std::string temp = path + ".tmp";
+  SDL_IOStream *io = SDL_IOFromFile(temp.c_str(), "wb");
+  if (!io) {
+    SDL_LogWarn(SDL_LOG_CATEGORY_CUSTOM, "Couldn't cache %s: %s",
+                path.c_str(), SDL_GetError());
+    return;
+  }
+  bool ok = SDL_WriteIO(io, &header, sizeof(header)) == sizeof(header);
+  for (int y = 0; ok && y < surface->h; ++y) {
+    ok = SDL_WriteIO(io,
+                     static_cast<const uint8_t *>(surface->pixels) +
+                         static_cast<size_t>(y) * surface->pitch,
+                     rowBytes) == rowBytes;
+  }
+  ok = SDL_CloseIO(io) && ok;
+  if (!ok || !SDL_RenamePath(temp.c_str(), path.c_str())) {
+    SDL_LogWarn(SDL_LOG_CATEGORY_CUSTOM, "Couldn't cache %s: %s",
+                path.c_str(), SDL_GetError());
+    SDL_RemovePath(temp.c_str());
+    return;
+  }
+  TrimImageCache(cacheDir, kImageCacheBytes);
+}
+
+// An image decoded (and mipmapped, if the GPU can't) off the main thread,
+// ready for CreateTextureFromSurface.
+struct DecodedImage {
+  SDL_Surface *surface = nullptr; // RGBA32
+  std::shared_ptr<void> pixels;   // backs surface when read from the cache
+  MipChain mips;
+};
+
+#ifdef __EMSCRIPTEN__
+// The web build has no pthreads, so worker jobs run when their result is
+// first requested.
+constexpr auto kWorkerLaunch = std::launch::deferred;
+#else
+constexpr auto kWorkerLaunch = std::launch::async;
+#endif
+
+// True if get() won't block on a worker. Deferred jobs count as ready: they
+// run inside get().
+template <typename T> static bool IsReady(const std::future<T> &future) {
+  return future.valid() && future.wait_for(std::chrono::seconds(0)) !=
+                               std::future_status::timeout;
+}
+
+// Decodes the encoded image in `source` (`size` bytes, kept alive by the
+// job). `path` names it in messages and the cache. `cacheDir`: where decoded
+// pixels are kept between runs (see "Image cache"), or empty to always
+// decode.
+std::future<DecodedImage> DecodeImageAsync(std::string path,
+                                           std::shared_ptr<const void> source,
+                                           size_t size, TextureMips mips,
+                                           std::string cacheDir = {}) {
+  return std::async(kWorkerLaunch, [path = std::move(path),
+                                    source = std::move(source), size, mips,
+                                    cacheDir = std::move(cacheDir)] {
+    DecodedImage image;
+    std::string cachePath;
+    uint64_t sourceHash = 0;
+    if (!cacheDir.empty()) {
+      sourceHash = HashBytes(0xCBF29CE484222325ull, source.get(), size);
+      cachePath = ImageCachePath(cacheDir, path, sourceHash);
+      image.surface = ReadCachedImage(cachePath, sourceHash, image.pixels);
+    }
+
+    if (!image.surface) {
+      SDL_IOStream *io = SDL_IOFromConstMem(source.get(), size);
+      SDL_Surface *loaded = io ? IMG_Load_IO(io, true) : nullptr;
+      if (!loaded) {
+        SDL_LogError(SDL_LOG_CATEGORY_CUSTOM, "IMG_Load(%s) failed: %s",
+                     path.c_str(), SDL_GetError());
+        return image;
+      }
+
+      image.surface = SDL_ConvertSurface(loaded, SDL_PIXELFORMAT_RGBA32);
+      SDL_DestroySurface(loaded);
+      if (!image.surface) {
+        SDL_LogError(SDL_LOG_CATEGORY_CUSTOM,
+                     "SDL_ConvertSurfaceFormat failed: %s", SDL_GetError());
+        return image;
+      }
+      if (!cachePath.empty()) {
+        WriteCachedImage(cacheDir, cachePath, sourceHash, image.surface);
+      }
+    }
+
+    if (mips == TextureMips::Generate && !pglGenerateMipmap &&
+        CanMipmap(image.surface->w, image.surface->h)) {
+      image.mips = BuildMipChain(image.surface);
+    }
+    return image;
+  });
+}
+
+void DestroyTexture(GLTexture &tex) {
+  if (tex.id) {
+    glDeleteTextures(1, &tex.id);
+    tex.id = 0;
+  }
+}
+
+// ------------------- Background uploads -------------------
+
+// glTexImage2D of a large image can take milliseconds of main-thread time.
+// Where the driver allows a second context sharing objects with the
+// renderer's, an uploader thread makes that context current and does the
+// upload there. The context is current on a hidden 1x1 window of its own,
+// since EGL won't make the main window's surface current on two threads. The texture is handed to the main thread once a fence
+// placed after the upload has signalled, so the main context never samples
+// a half-written texture. Without shared contexts or fences (and always on
+// the web) uploads happen synchronously on the calling thread.
+struct TextureUpload {
+  SDL_Surface *surface = nullptr; // owned by the upload
+  TextureMips mips = TextureMips::None;
+  MipChain prebuilt;
+  GLuint reuse = 0; // see CreateTextureFromSurface
+  std::promise<GLTexture> result;
+};
+
+#ifndef __EMSCRIPTEN__
+struct FencedTexture {
+  GLTexture texture;
+  GLsync fence = nullptr;
+  std::promise<GLTexture> result;
+};
+#endif
+
+struct TextureUploader {
+  SDL_Window *surface = nullptr;   // hidden window the context is current on
+  SDL_GLContext context = nullptr; // nullptr: synchronous uploads
+#ifndef __EMSCRIPTEN__
+  std::thread thread;
+  std::mutex mutex; // guards everything below
+  std::condition_variable wake;
+  std::deque<TextureUpload> queued;
+  std::vector<FencedTexture> uploaded; // waiting on their fence
+  bool stopping = false;
+#endif
+};
+
+static GLTexture RunTextureUpload(TextureUpload &upload) {
+  const GLTexture texture = CreateTextureFromSurface(
+      upload.surface, upload.mips,
+      upload.prebuilt.empty() ? nullptr : &upload.prebuilt, upload.reuse);
+  SDL_DestroySurface(upload.surface);
+  upload.surface = nullptr;
+  return texture;
+}
+
+#ifndef __EMSCRIPTEN__
+// Reports through `started` whether the context could be made current; if
+// not, it returns without taking any uploads.
+static void TextureUploadThread(TextureUploader *uploader,
+                                std::promise<bool> started) {
+  if (!SDL_GL_MakeCurrent(uploader->surface, uploader->context)) {
+    SDL_LogWarn(SDL_LOG_CATEGORY_CUSTOM,
+                "Upload context unusable, uploading on the main thread: %s",
+                SDL_GetError());
+    started.set_value(false);
+    return;
+  }
+  started.set_value(true);
+
+  std::unique_lock lock(uploader->mutex);
+  for (;;) {
+    uploader->wake.wait(lock, [uploader] {
+      return uploader->stopping || !uploader->queued.empty();
+    });
+    if (uploader->stopping) {
+      break;
+    }
+    TextureUpload upload = std::move(uploader->queued.front());
+    uploader->queued.pop_front();
+    lock.unlock();
+
+    FencedTexture done;
+    done.texture = RunTextureUpload(upload);
+    done.fence = pglFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush(); // make sure the fence reaches the GPU
+    done.result = std::move(upload.result);
+
+    lock.lock();
+    uploader->uploaded.push_back(std::move(done));
+  }
+  SDL_GL_MakeCurrent(uploader->surface, nullptr);
+}
+#endif
+
+// Creates the upload context and thread. Returns false (and uploads stay
+// synchronous) if the driver can't share objects, has no fences or won't
+// make the context current on the thread.
+bool InitTextureUploader(TextureUploader &uploader, SDL_Window *window,
+                         const GLRenderer &renderer) {
+#ifdef __EMSCRIPTEN__
+  (void)uploader;
+  (void)window;
+  (void)renderer;
+  return false;
+#else
+  if (!pglFenceSync) {
+    return false;
+  }
+  uploader.surface = SDL_CreateWindow("Texture uploads", 1, 1,
+                                      SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+  if (uploader.surface) {
+    SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 1);
+    uploader.context = SDL_GL_CreateContext(uploader.surface); // current
+    SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 0);
+    SDL_GL_MakeCurrent(window, renderer.context);
+  }
+  if (!uploader.context) {
+    SDL_LogWarn(SDL_LOG_CATEGORY_CUSTOM,
+                "No shared GL context, uploading on the main thread: %s",
+                SDL_GetError());
+    SDL_DestroyWindow(uploader.surface);
+    uploader.surface = nullptr;
+    return false;
+  }
+
+  // wait for the thread to take the context, so that a failure falls back
+  // to synchronous uploads before anything is queued
+  std::promise<bool> started;
+  std::future<bool> usable = started.get_future();
+  uploader.thread =
+      std::thread(TextureUploadThread, &uploader, std::move(started));
+  if (!usable.get()) {
+    uploader.thread.join();
+    SDL_GL_DestroyContext(uploader.context);
+    uploader.context = nullptr;
+    SDL_DestroyWindow(uploader.surface);
+    uploader.surface = nullptr;
+    return false;
+  }
+  return true;
+#endif
+}
+
+// Uploads `surface` (which the uploader takes over) and resolves the future
+// once the texture is safe to draw with on the main thread. Poll with
+// PollTextureUploads each frame.
+std::future<GLTexture> UploadTextureAsync(TextureUploader &uploader,
+                                          SDL_Surface *surface,
+                                          TextureMips mips = TextureMips::None,
+                                          MipChain prebuilt = {},
+                                          GLuint reuse = 0) {
+  TextureUpload upload{surface, mips, std::move(prebuilt), reuse, {}};
+  std::future<GLTexture> result = upload.result.get_future();
+#ifndef __EMSCRIPTEN__
+  if (uploader.context) {
+    {
+      std::lock_guard lock(uploader.mutex);
+      uploader.queued.push_back(std::move(upload));
+    }
+    uploader.wake.notify_one();
+    return result;
+  }
+#else
+  (void)uploader;
+#endif
+  upload.result.set_value(RunTextureUpload(upload));
+  return result;
+}
+
+// Hands over the textures whose upload the GPU has finished. Main thread.
+void PollTextureUploads(TextureUploader &uploader) {
+#ifndef __EMSCRIPTEN__
+  std::lock_guard lock(uploader.mutex);
+  auto &uploaded = uploader.uploaded;
+  for (size_t i = 0; i < uploaded.size();) {
+    FencedTexture &done = uploaded[i];
+    const GLenum status = pglClientWaitSync(done.fence, 0, 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+      ++i;
+      continue;
+    }
+    pglDeleteSync(done.fence);
+    done.result.set_value(done.texture);
+    uploaded[i] = std::move(uploaded.back());
+    uploaded.pop_back();
+  }
+#else
+  (void)uploader;
+#endif
+}
+
+// Stops the thread. Uploads still queued are dropped and finished ones
+// deleted; their futures must not be waited on any more.
+void ShutdownTextureUploader(TextureUploader &uploader) {
+#ifndef __EMSCRIPTEN__
+  if (!uploader.context) {
+    return;
+  }
+  {
+    std::lock_guard lock(uploader.mutex);
+    uploader.stopping = true;
+  }
+  uploader.wake.notify_one();
+  uploader.thread.join();
+
+  for (TextureUpload &upload : uploader.queued) {
+    SDL_DestroySurface(upload.surface);
+    if (upload.reuse) {
+      glDeleteTextures(1, &upload.reuse);
+    }
+  }
+  for (FencedTexture &done : uploader.uploaded) {
+    pglClientWaitSync(done.fence, GL_SYNC_FLUSH_COMMANDS_BIT, UINT64_MAX);
+    pglDeleteSync(done.fence);
+    DestroyTexture(done.texture);
+  }
+  uploader.queued.clear();
+  uploader.uploaded.clear();
+  SDL_GL_DestroyContext(uploader.context);
+  uploader.context = nullptr;
+  SDL_DestroyWindow(uploader.surface);
+  uploader.surface = nullptr;
+#else
+  (void)uploader;
+#endif
+}
+
+// ------------------- Dynamic textures -------------------
+
+// A texture whose contents change often (labels, video frames, CPU-drawn
+// maps). Storage for a ring of same-sized textures is allocated once; each
+// update only uploads dirty rectangles into the slot after the front one and
+// makes it the front. With one more slot than frames that can be in flight
+// and at most one update per frame, the slot written was last sampled by a
+// frame the GPU has finished, so we never write a texture an in-flight frame
+// may still read.
+constexpr int kDynamicTextureSlots =
+    static_cast<int>(kAssumedFramesInFlight) + 1;
+
+struct GLDynamicTexture {
+  GLTexture slots[kDynamicTextureSlots];
+  int front = 0; // slot that draws sample from
+
+  // Rects changed since each slot was last uploaded to.
+  std::vector<SDL_Rect> pending[kDynamicTextureSlots];
+  std::vector<uint8_t> scratch; // packing buffer for GLES2 (no ROW_LENGTH)
+};
+
+// Past this many rects per slot we upload their bounding box instead.
+constexpr size_t kMaxPendingRects = 16;
+
+static void AllocateTextureStorage(GLTexture &tex, int width, int height) {
+  glGenTextures(1, &tex.id);
+  glBindTexture(GL_TEXTURE_2D, tex.id);
+
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+  if (pglTexStorage2D) {
+    // Immutable storage: the driver never has to re-validate the level chain.
+    pglTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width, height);
+  } else {
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA,
+                 GL_UNSIGNED_BYTE, nullptr);
+  }
+
+  tex.width = width;
+  tex.height = height;
+}
+
+static void AddPendingRect(std::vector<SDL_Rect> &rects, const SDL_Rect &r) {
+  rects.push_back(r);
+  if (rects.size() <= kMaxPendingRects) {
+    return;
+  }
+
+  SDL_Rect bounds = rects[0];
+  for (const SDL_Rect &other : rects) {
+    SDL_GetRectUnion(&bounds, &other, &bounds);
+  }
+  rects.assign(1, bounds);
+}
+
+// The texture has undefined contents until the first UpdateDynamicTexture.
+GLDynamicTexture CreateDynamicTexture(int width, int height) {
+  GLDynamicTexture dyn;
+  if (width <= 0 || height <= 0) {
+    return dyn;
+  }
+
+  for (GLTexture &slot : dyn.slots) {
+    AllocateTextureStorage(slot, width, height);
+  }
+
+  // Freshly allocated storage is undefined, so every slot starts fully dirty.
+  const SDL_Rect all{0, 0, width, height};
+  for (std::vector<SDL_Rect> &rects : dyn.pending) {
+    rects.push_back(all);
+  }
+
+  return dyn;
+}
+
+// Uploads the given dirty rects of `content` (a full-size image of the
+// texture) into the next slot and makes it the front. `content` must have
+// the same dimensions as the texture; rects are clipped to it.
+void UpdateDynamicTexture(GLRenderer &renderer, GLDynamicTexture &dyn,
+                          SDL_Surface *content, const SDL_Rect *rects,
+                          int count) {
+  const int next = (dyn.front + 1) % kDynamicTextureSlots;
+  GLTexture &back = dyn.slots[next];
+  if (!back.id || !content) {
+    return;
+  }
+  if (content->w != back.width || content->h != back.height) {
+    SDL_LogError(SDL_LOG_CATEGORY_CUSTOM,
+                 "Dynamic texture update is %ix%i, texture is %ix%i",
+                 content->w, content->h, back.width, back.height);
+    return;
+  }
+
+  const SDL_Rect bounds{0, 0, back.width, back.height};
+  for (int i = 0; i < count; ++i) {
+    SDL_Rect clipped;
+    if (SDL_GetRectIntersection(&rects[i], &bounds, &clipped)) {
+      for (std::vector<SDL_Rect> &slotRects : dyn.pending) {
+        AddPendingRect(slotRects, clipped);
+      }
+    }
+  }
+
+  std::vector<SDL_Rect> &todo = dyn.pending[next];
+  if (todo.empty()) {
+    return;
+  }
+
+  SDL_Surface *rgba = content;
+  if (content->format != SDL_PIXELFORMAT_RGBA32) {
+    rgba = SDL_ConvertSurface(content, SDL_PIXELFORMAT_RGBA32);
+    if (!rgba) {
+      SDL_LogError(SDL_LOG_CATEGORY_CUSTOM,
+                   "SDL_ConvertSurfaceFormat failed: %s", SDL_GetError());
+      return;
+    }
+  }
+
+  // queued draws may still sample the back slot
+  if (renderer.batch.texture == back.id) {
+    FlushBatch(renderer);
+  }
+  glBindTexture(GL_TEXTURE_2D, back.id);
+
+  GLint prevAlign = 0;
+  glGetIntegerv(GL_UNPACK_ALIGNMENT, &prevAlign);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+  const auto *pixels = static_cast<const uint8_t *>(rgba->pixels);
+  for (const SDL_Rect &r : todo) {
+    const uint8_t *first = pixels + r.y * rgba->pitch + r.x * 4;
+#ifdef __EMSCRIPTEN__
+    // GLES2 has no GL_UNPACK_ROW_LENGTH, so pack the rows ourselves unless
+    // the rect already spans whole rows.
+    if (r.w * 4 != rgba->pitch) {
+      dyn.scratch.resize(static_cast<size_t>(r.w) * r.h * 4);
+      for (int row = 0; row < r.h; ++row) {
+        std::memcpy(dyn.scratch.data() + static_cast<size_t>(row) * r.w * 4,
+                    first + row * rgba->pitch, static_cast<size_t>(r.w) * 4);
+      }
+      first = dyn.scratch.data();
+    }
+#else
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, rgba->pitch / 4);
+#endif
+    glTexSubImage2D(GL_TEXTURE_2D, 0, r.x, r.y, r.w, r.h, GL_RGBA,
+                    GL_UNSIGNED_BYTE, first);
+    renderer.stats.textureUploadBytes += static_cast<uint64_t>(r.w) * r.h * 4;
+  }
+
+#ifndef __EMSCRIPTEN__
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+#endif
+  glPixelStorei(GL_UNPACK_ALIGNMENT, prevAlign);
+
+  if (rgba != content) {
+    SDL_DestroySurface(rgba);
+  }
+
+  todo.clear();
+  dyn.front = next;
+}
+
+const GLTexture &DynamicTextureFront(const GLDynamicTexture &dyn) {
+  return dyn.slots[dyn.front];
+}
+
+void DestroyDynamicTexture(GLRenderer &renderer, GLDynamicTexture &dyn) {
+  for (GLTexture &slot : dyn.slots) {
+    RetireTexture(renderer, slot);
+  }
+  for (std::vector<SDL_Rect> &rects : dyn.pending) {
+    rects.clear();
+  }
+}
+
+void BeginFrame(GLRenderer &renderer, SDL_Window *window, float r, float g,
+                float b) {
+  renderer.lastStats = renderer.stats;
+  renderer.stats = {};
+  CollectRetiredObjects(renderer);
+
+  int w, h;
+  SDL_GetWindowSizeInPixels(window, &w, &h);
+
+  glViewport(0, 0, w, h);
+
+#ifndef __EMSCRIPTEN__
+  glMatrixMode(GL_PROJECTION);
+  glLoadIdentity();
+  glOrtho(0, w, h, 0, -1, 1); // origin top-left
+  glMatrixMode(GL_MODELVIEW);
+  glLoadIdentity();
+#else
+  pglUseProgram(renderer.program);
+  pglUniform2f(renderer.uResolutionLoc, static_cast<float>(w),
+               static_cast<float>(h));
+#endif
+
+  glClearColor(r, g, b, 1.0f);
+  glClear(GL_COLOR_BUFFER_BIT);
+}
+
+// Draws the [u0,u1] x [v0,v1] part of a texture into the given pixel rect.
+void DrawTextureRegion(GLRenderer &renderer, const GLTexture &tex, float x,
+                       float y, float w, float h, float u0, float v0, float u1,
+                       float v1, SDL_Color tint = {255, 255, 255, 255}) {
+  if (!tex.id) {
+    return;
+  }
+
+  const uint16_t base = ReserveBatch(renderer, tex.id, 4, 6);
+  renderer.batch.vertices.insert(renderer.batch.vertices.end(),
+                                 {{x, y, u0, v0, tint},
+                                  {x + w, y, u1, v0, tint},
+                                  {x + w, y + h, u1, v1, tint},
+                                  {x, y + h, u0, v1, tint}});
+  PushQuadIndices(renderer.batch, base);
+}
+
+void DrawTexture(GLRenderer &renderer, const GLTexture &tex, float x, float y,
+                 float w, float h) {
+  DrawTextureRegion(renderer, tex, x, y, w, h, 0.0f, 0.0f, 1.0f, 1.0f);
+}
+
+void EndFrame(SDL_Window *window) { SDL_GL_SwapWindow(window); }
+
+// Call after presenting. Fences the frame and, with `framesInFlight` of 1 to
+// 3, blocks until the GPU has finished the frame that many frames back, so
+// the CPU can't queue more than that ahead of the GPU: fewer frames in
+// flight means less input latency, more means fewer stalls. 0 leaves it to
+// the driver. Returns the time spent waiting, which is also in the stats.
+uint64_t EndFrameInFlight(GLRenderer &renderer, int framesInFlight) {
+  const uint64_t submitted = renderer.frame;
+  FenceFrame(renderer);
+  if (framesInFlight <= 0 ||
+      submitted < static_cast<uint64_t>(framesInFlight)) {
+    return 0; // off, or not that many frames yet
+  }
+
+  const uint64_t start = SDL_GetTicksNS();
+  if (HasFrameFences()) {
+#ifndef __EMSCRIPTEN__
+    // the newest fence at or before the frame we have to wait for
+    const uint64_t target = submitted + 1 - framesInFlight;
+    GLsync fence = nullptr;
+    for (const GLFrameFence &f : renderer.frameFences) {
+      if (f.frame > target) {
+        break;
+      }
+      fence = f.fence;
+    }
+    if (fence) {
+      pglClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                        SDL_NS_PER_SECOND); // don't hang on a lost device
+      PollFrameFences(renderer);
+    }
+#endif
+  } else if (framesInFlight == 1) {
+    glFinish(); // no fences, but one frame in flight is still possible
+  }
+  const uint64_t waited = SDL_GetTicksNS() - start;
+  renderer.stats.frameWaitNS += waited;
+  return waited;
+}
+
+// ------------------- Render targets -------------------
+
+// An offscreen colour buffer that can be drawn into and then sampled.
+struct GLRenderTarget {
+  GLuint fbo = 0;
+  GLTexture color;
+};
+
+bool RenderTargetsSupported() { return pglGenFramebuffers != nullptr; }
+
+GLRenderTarget CreateRenderTarget(int width, int height) {
+  GLRenderTarget target;
+  if (!RenderTargetsSupported() || width <= 0 || height <= 0) {
+    return target;
+  }
+
+  glGenTextures(1, &target.color.id);
+  glBindTexture(GL_TEXTURE_2D, target.color.id);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA,
+               GL_UNSIGNED_BYTE, nullptr);
+  target.color.width = width;
+  target.color.height = height;
+
+  GLint prevFbo = 0;
+  glGetIntegerv(GL_FRAMEBUFFER_BINDING, &prevFbo);
+
+  pglGenFramebuffers(1, &target.fbo);
+  pglBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+  pglFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                          target.color.id, 0);
+  const GLenum status = pglCheckFramebufferStatus(GL_FRAMEBUFFER);
+  pglBindFramebuffer(GL_FRAMEBUFFER, static_cast<GLuint>(prevFbo));
+
+  if (status != GL_FRAMEBUFFER_COMPLETE) {
+    SDL_LogError(SDL_LOG_CATEGORY_CUSTOM, "Framebuffer incomplete: 0x%x",
+                 static_cast<unsigned>(status));
+    pglDeleteFramebuffers(1, &target.fbo);
+    target.fbo = 0;
+    DestroyTexture(target.color);
+  }
+
+  return target;
+}
+
+// Deletes the target once no in-flight frame can draw to or sample it.
+void RetireRenderTarget(GLRenderer &renderer, GLRenderTarget &target) {
+  RetireFramebuffer(renderer, target.fbo);
+  RetireTexture(renderer, target.color);
+}
+
+// Render targets shared by everything that needs offscreen space for part of
+// a frame. Targets are handed out by size and format and returned when their
+// user is done, so users whose lifetimes don't overlap share memory.
+struct RenderTargetDesc {
+  int width = 0;
+  int height = 0;
+  GLenum format = GL_RGBA;
+
+  bool operator==(const RenderTargetDesc &) const = default;
+};
+
+struct PooledRenderTarget {
+  RenderTargetDesc desc;
+  GLRenderTarget target;
+  bool inUse = false;
+  uint64_t lastUsedFrame = 0;
+};
+
+struct RenderTargetPool {
+  std::vector<PooledRenderTarget> entries;
+  uint64_t frame = 0;
+  int evictAfterFrames = 60; // drop targets nobody asked for in this long
+};
+
+// Returns the index of a free target matching `desc`, creating one if
+// needed, or -1 on failure.
+int AcquirePooledTarget(RenderTargetPool &pool, const RenderTargetDesc &desc) {
+  for (size_t i = 0; i < pool.entries.size(); ++i) {
+    PooledRenderTarget &entry = pool.entries[i];
+    if (!entry.inUse && entry.desc == desc) {
+      entry.inUse = true;
+      entry.lastUsedFrame = pool.frame;
+      return static_cast<int>(i);
+    }
+  }
+
+  // Only RGBA colour targets for now; `format` keeps keys future-proof.
+  GLRenderTarget target = CreateRenderTarget(desc.width, desc.height);
+  if (!target.fbo) {
+    return -1;
+  }
+  pool.entries.push_back({desc, target, true, pool.frame});
+  return static_cast<int>(pool.entries.size() - 1);
+}
+
+void ReleasePooledTarget(RenderTargetPool &pool, int index) {
+  if (index >= 0) {
+    pool.entries[index].inUse = false;
+  }
+}
+
+// Call once per frame after all targets were released.
+void TrimRenderTargetPool(RenderTargetPool &pool, GLRenderer &renderer) {
+  ++pool.frame;
+  std::erase_if(pool.entries, [&](PooledRenderTarget &entry) {
+    const bool stale =
+        !entry.inUse && pool.frame - entry.lastUsedFrame >
+                            static_cast<uint64_t>(pool.evictAfterFrames);
+    if (stale) {
+      RetireRenderTarget(renderer, entry.target);
+    }
+    return stale;
+  });
+}
+
+void DestroyRenderTargetPool(RenderTargetPool &pool, GLRenderer &renderer) {
+  for (PooledRenderTarget &entry : pool.entries) {
+    RetireRenderTarget(renderer, entry.target);
+  }
+  pool.entries.clear();
+}
+
+// ------------------- Dynamic resolution -------------------
+
+// Renders the scene into an offscreen target at a fraction of the backbuffer
+// size and upscales it, adjusting the fraction from measured frame cost to
+// hold the display's refresh rate. Anything drawn after EndScaledScene (UI,
+// text) goes straight to the backbuffer at native resolution.
+//
+// The target is a full backbuffer-sized render target supplied by the caller
+// (the frame graph), so changing `scale` only changes the viewport.
+struct RenderScale {
+  bool enabled = true;
+  bool automatic = true; // false: `scale` is fixed by the user
+  float scale = 1.0f;
+  float minScale = 0.5f;
+  float maxScale = 1.0f;
+  float step = 0.05f;
+  float targetFrameMs = 1000.0f / 60.0f;
+
+  // Cost estimate the controller acts on: GPU time of the scene pass when
+  // timer queries exist, otherwise the CPU-side frame interval.
+  float smoothedMs = 0.0f;
+  int cooldownFrames = 0;
+
+  int viewWidth = 0;
+  int viewHeight = 0;
+  float presentedScale = 0.0f; // effective scale the backbuffer shows
+
+  static constexpr int kQueryCount = 3; // results are read 2 frames late
+  GLuint queries[kQueryCount] = {};
+  bool queryIssued[kQueryCount] = {};
+  int queryIndex = 0;
+  uint64_t lastFrameNS = 0;
+};
+
+void InitRenderScale(RenderScale &rs, SDL_Window *window) {
+  if (!RenderTargetsSupported()) {
+    SDL_Log("Render scale disabled: framebuffer objects not supported");
+    rs.enabled = false;
+    return;
+  }
+
+  const SDL_DisplayMode *mode =
+      SDL_GetCurrentDisplayMode(SDL_GetDisplayForWindow(window));
+  if (mode && mode->refresh_rate > 0.0f) {
+    rs.targetFrameMs = 1000.0f / mode->refresh_rate;
+  }
+
+  if (pglGenQueries) {
+    pglGenQueries(RenderScale::kQueryCount, rs.queries);
+  }
+}
+
+void ShutdownRenderScale(RenderScale &rs) {
+  if (rs.queries[0]) {
+    pglDeleteQueries(RenderScale::kQueryCount, rs.queries);
+    std::fill(std::begin(rs.queries), std::end(rs.queries), 0);
+  }
+}
+
+// Restricts drawing to the scaled part of the bound target, which must be at
+// least `width` x `height` (the backbuffer size), and clears it. Drawing keeps
+// using backbuffer pixel coordinates.
+void BeginScaledScene(GLRenderer &renderer, RenderScale &rs, int w, int h,
+                      float r, float g, float b) {
+  FlushBatch(renderer);
+  rs.viewWidth = std::max(1, static_cast<int>(std::lround(w * rs.scale)));
+  rs.viewHeight = std::max(1, static_cast<int>(std::lround(h * rs.scale)));
+
+  glViewport(0, 0, rs.viewWidth, rs.viewHeight);
+  glClearColor(r, g, b, 1.0f);
+  glClear(GL_COLOR_BUFFER_BIT);
+
+  if (rs.queries[0]) {
+    pglBeginQuery(GL_TIME_ELAPSED, rs.queries[rs.queryIndex]);
+  }
+}
+
+static void AdjustRenderScale(RenderScale &rs, float frameMs) {
+  rs.smoothedMs = rs.smoothedMs == 0.0f
+                      ? frameMs
+                      : rs.smoothedMs + (frameMs - rs.smoothedMs) * 0.1f;
+
+  if (!rs.automatic) {
+    return;
+  }
+  if (rs.cooldownFrames > 0) {
+    --rs.cooldownFrames;
+    return;
+  }
+
+  // GPU time has headroom information; a vsynced frame interval only tells
+  // us whether we missed the deadline, so probe upwards more cautiously.
+  const bool gpuTimed = rs.queries[0] != 0;
+  const float high = rs.targetFrameMs * (gpuTimed ? 0.9f : 1.2f);
+  const float low = rs.targetFrameMs * (gpuTimed ? 0.7f : 1.05f);
+
+  float next = rs.scale;
+  if (rs.smoothedMs > high) {
+    next = std::max(rs.minScale, rs.scale - rs.step);
+  } else if (rs.smoothedMs < low) {
+    next = std::min(rs.maxScale, rs.scale + rs.step);
+  }
+
+  if (next != rs.scale) {
+    SDL_LogDebug(SDL_LOG_CATEGORY_CUSTOM,
+                 "Render scale %.2f -> %.2f (%.2f ms, target %.2f ms)",
+                 rs.scale, next, rs.smoothedMs, rs.targetFrameMs);
+    rs.scale = next;
+    // Give the new scale time to show up in the measurements (and wait
+    // longer before growing again) so we don't oscillate.
+    rs.cooldownFrames = rs.smoothedMs > high ? 15 : (gpuTimed ? 30 : 120);
+  }
+}
+
+// Ends the scene and updates the scale for the next frame.
+void EndScaledScene(GLRenderer &renderer, RenderScale &rs) {
+  FlushBatch(renderer); // so the query covers the scene's draws
+  if (rs.queries[0]) {
+    pglEndQuery(GL_TIME_ELAPSED);
+    rs.queryIssued[rs.queryIndex] = true;
+    rs.queryIndex = (rs.queryIndex + 1) % RenderScale::kQueryCount;
+
+    // The slot we write next frame is the oldest one; read it if done.
+    const GLuint oldest = rs.queries[rs.queryIndex];
+    GLint available = 0;
+    if (rs.queryIssued[rs.queryIndex]) {
+      pglGetQueryObjectiv(oldest, GL_QUERY_RESULT_AVAILABLE, &available);
+    }
+    if (available) {
+      uint64_t ns = 0;
+      pglGetQueryObjectui64v(oldest, GL_QUERY_RESULT, &ns);
+      AdjustRenderScale(rs, static_cast<float>(ns) / 1e6f);
+    }
+  } else {
+    const uint64_t now = SDL_GetTicksNS();
+    if (rs.lastFrameNS) {
+      AdjustRenderScale(rs, static_cast<float>(now - rs.lastFrameNS) / 1e6f);
+    }
+    rs.lastFrameNS = now;
+  }
+}
+
+// Draws the scaled scene over the whole of the currently bound framebuffer.
+void UpscaleScene(GLRenderer &renderer, const RenderScale &rs,
+                  const GLRenderTarget &target, SDL_Window *window) {
+  int w, h;
+  SDL_GetWindowSizeInPixels(window, &w, &h);
+
+  // The target is bottom-up and only its lower-left view rect is valid.
+  const float u1 = static_cast<float>(rs.viewWidth) / target.color.width;
+  const float v1 = static_cast<float>(rs.viewHeight) / target.color.height;
+
+  FlushBatch(renderer);
+  glDisable(GL_BLEND);
+  DrawTextureRegion(renderer, target.color, 0.0f, 0.0f, static_cast<float>(w),
+                    static_cast<float>(h), 0.0f, v1, u1, 0.0f);
+  FlushBatch(renderer);
+  glEnable(GL_BLEND);
+}
+
+// ------------------- Frame graph -------------------
+
+// Describes a frame as passes that read and write render targets. Compiling
+// the graph drops passes whose output never reaches the backbuffer, orders
+// the rest by their dependencies and works out how long each transient
+// target lives; executing it takes targets from the pool at first use and
+// returns them after last use, so targets with disjoint lifetimes alias.
+//
+// Passes draw in backbuffer pixel coordinates; the graph binds the pass's
+// output and sets the viewport to cover it.
+using FrameGraphResource = int;
+constexpr FrameGraphResource kBackbuffer = 0;
+
+struct FrameGraphPass {
+  const char *name = "";
+  std::vector<FrameGraphResource> reads;
+  FrameGraphResource output = kBackbuffer;
+  std::function<void()> execute;
+  bool culled = false;
+};
+
+struct FrameGraphTarget {
+  RenderTargetDesc desc;
+  int poolIndex = -1;
+  int firstUse = -1; // positions in FrameGraph::order
+  int lastUse = -1;
+  bool missing = false; // not allocated, or its writer was skipped
+};
+
+struct FrameGraph {
+  GLRenderer *renderer = nullptr; // flushed after every pass
+  RenderTargetPool *pool = nullptr;
+  std::vector<FrameGraphTarget> targets{1}; // [0] is the backbuffer
+  std::vector<FrameGraphPass> passes;
+  std::vector<int> order; // live passes in execution order
+
+  // When set, passes drawing to the backbuffer are clipped to this rect
+  // (top-left origin), e.g. the damaged region of a partial redraw.
+  const SDL_Rect *backbufferScissor = nullptr;
+
+  int culledPasses = 0; // stats of the last compile
+  bool missingTarget = false; // a pass was skipped for want of its target
+};
+
+void ResetFrameGraph(FrameGraph &graph) {
+  graph.targets.assign(1, FrameGraphTarget{});
+  graph.passes.clear();
+  graph.order.clear();
+  graph.culledPasses = 0;
+  graph.missingTarget = false;
+}
+
+FrameGraphResource CreateTransientTarget(FrameGraph &graph,
+                                         const RenderTargetDesc &desc) {
+  FrameGraphTarget target;
+  target.desc = desc;
+  graph.targets.push_back(target);
+  return static_cast<FrameGraphResource>(graph.targets.size() - 1);
+}
+
+void AddPass(FrameGraph &graph, const char *name,
+             std::vector<FrameGraphResource> reads, FrameGraphResource output,
+             std::function<void()> execute) {
+  FrameGraphPass pass;
+  pass.name = name;
+  pass.reads = std::move(reads);
+  pass.output = output;
+  pass.execute = std::move(execute);
+  graph.passes.push_back(std::move(pass));
+}
+
+void CompileFrameGraph(FrameGraph &graph) {
+  const int passCount = static_cast<int>(graph.passes.size());
+
+  // Cull: everything the backbuffer (transitively) depends on is live.
+  std::vector<bool> live(passCount, false);
+  std::vector<FrameGraphResource> needed{kBackbuffer};
+  std::vector<bool> resourceNeeded(graph.targets.size(), false);
+  resourceNeeded[kBackbuffer] = true;
+  while (!needed.empty()) {
+    const FrameGraphResource resource = needed.back();
+    needed.pop_back();
+    for (int i = 0; i < passCount; ++i) {
+      if (live[i] || graph.passes[i].output != resource) {
+        continue;
+      }
+      live[i] = true;
+      for (FrameGraphResource read : graph.passes[i].reads) {
+        if (!resourceNeeded[read]) {
+          resourceNeeded[read] = true;
+          needed.push_back(read);
+        }
+      }
+    }
+  }
+
+  // Order: a pass runs after every writer of what it reads; writers of the
+  // same target keep their declaration order. Ties keep declaration order.
+  std::vector<std::vector<int>> dependents(passCount);
+  std::vector<int> pending(passCount, 0);
+  for (int i = 0; i < passCount; ++i) {
+    if (!live[i]) {
+      continue;
+    }
+    for (int j = 0; j < passCount; ++j) {
+      if (i == j || !live[j]) {
+        continue;
+      }
+      const FrameGraphPass &pass = graph.passes[i];
+      const FrameGraphPass &other = graph.passes[j];
+      const bool readsOther =
+          std::find(pass.reads.begin(), pass.reads.end(), other.output) !=
+          pass.reads.end();
+      const bool earlierWriter = j < i && other.output == pass.output;
+      if (readsOther || earlierWriter) {
+        dependents[j].push_back(i);
+        ++pending[i];
+      }
+    }
+  }
+
+  graph.order.clear();
+  std::vector<bool> scheduled(passCount, false);
+  bool progress = true;
+  while (progress) {
+    progress = false;
+    for (int i = 0; i < passCount; ++i) {
+      if (live[i] && !scheduled[i] && pending[i] == 0) {
+        scheduled[i] = true;
+        graph.order.push_back(i);
+        for (int dependent : dependents[i]) {
+          --pending[dependent];
+        }
+        progress = true;
+        break;
+      }
+    }
+  }
+
+  for (int i = 0; i < passCount; ++i) {
+    if (live[i] && !scheduled[i]) {
+      SDL_LogError(SDL_LOG_CATEGORY_CUSTOM,
+                   "Frame graph cycle at pass '%s'; running in declaration "
+                   "order",
+                   graph.passes[i].name);
+      graph.order.clear();
+      for (int k = 0; k < passCount; ++k) {
+        if (live[k]) {
+          graph.order.push_back(k);
+        }
+      }
+      break;
+    }
+  }
+
+  graph.culledPasses = 0;
+  for (int i = 0; i < passCount; ++i) {
+    graph.passes[i].culled = !live[i];
+    graph.culledPasses += live[i] ? 0 : 1;
+  }
+
+  // Lifetimes of transient targets, in execution positions.
+  for (int pos = 0; pos < static_cast<int>(graph.order.size()); ++pos) {
+    const FrameGraphPass &pass = graph.passes[graph.order[pos]];
+    auto touch = [&](FrameGraphResource resource) {
+      FrameGraphTarget &target = graph.targets[resource];
+      if (target.firstUse < 0) {
+        target.firstUse = pos;
+      }
+      target.lastUse = pos;
+    };
+    touch(pass.output);
+    for (FrameGraphResource read : pass.reads) {
+      touch(read);
+    }
+  }
+}
+
+const GLRenderTarget &GetFrameGraphTarget(const FrameGraph &graph,
+                                          FrameGraphResource resource) {
+  static const GLRenderTarget kNone;
+  const int index = graph.targets[resource].poolIndex;
+  return index >= 0 ? graph.pool->entries[index].target : kNone;
+}
+
+void ExecuteFrameGraph(FrameGraph &graph, SDL_Window *window) {
+  // The window's framebuffer isn't always 0 (e.g. on iOS).
+  GLint backbufferFbo = 0;
+  if (RenderTargetsSupported()) {
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &backbufferFbo);
+  }
+
+  int w, h;
+  SDL_GetWindowSizeInPixels(window, &w, &h);
+
+  for (int pos = 0; pos < static_cast<int>(graph.order.size()); ++pos) {
+    FrameGraphPass &pass = graph.passes[graph.order[pos]];
+
+    for (size_t r = 1; r < graph.targets.size(); ++r) {
+      FrameGraphTarget &target = graph.targets[r];
+      if (target.firstUse == pos) {
+        target.poolIndex = AcquirePooledTarget(*graph.pool, target.desc);
+      }
+    }
+
+    // a pass without its target is skipped, and so is every pass reading
+    // what it would have drawn
+    bool skip = false;
+    if (pass.output != kBackbuffer &&
+        !GetFrameGraphTarget(graph, pass.output).fbo) {
+      SDL_LogError(SDL_LOG_CATEGORY_CUSTOM,
+                   "Frame graph pass '%s' has no target, skipping", pass.name);
+      skip = true;
+    }
+    for (FrameGraphResource read : pass.reads) {
+      if (!skip && graph.targets[read].missing) {
+        SDL_LogError(SDL_LOG_CATEGORY_CUSTOM,
+                     "Frame graph pass '%s' reads a skipped pass, skipping",
+                     pass.name);
+        skip = true;
+      }
+    }
+
+    if (skip) {
+      graph.missingTarget = true;
+      if (pass.output != kBackbuffer) {
+        graph.targets[pass.output].missing = true;
+      }
+    } else if (pass.output == kBackbuffer) {
+      if (RenderTargetsSupported()) {
+        pglBindFramebuffer(GL_FRAMEBUFFER, static_cast<GLuint>(backbufferFbo));
+      }
+      glViewport(0, 0, w, h);
+      if (const SDL_Rect *clip = graph.backbufferScissor) {
+        glEnable(GL_SCISSOR_TEST);
+        glScissor(clip->x, h - clip->y - clip->h, clip->w, clip->h);
+      }
+    } else {
+      glDisable(GL_SCISSOR_TEST);
+      const GLRenderTarget &target = GetFrameGraphTarget(graph, pass.output);
+      pglBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+      glViewport(0, 0, target.color.width, target.color.height);
+    }
+
+    if (!skip) {
+      pass.execute();
+      FlushBatch(*graph.renderer);
+    }
+
+    for (size_t r = 1; r < graph.targets.size(); ++r) {
+      FrameGraphTarget &target = graph.targets[r];
+      if (target.lastUse == pos) {
+        ReleasePooledTarget(*graph.pool, target.poolIndex);
+      }
+    }
+  }
+
+  if (RenderTargetsSupported()) {
+    pglBindFramebuffer(GL_FRAMEBUFFER, static_cast<GLuint>(backbufferFbo));
+  }
+  glViewport(0, 0, w, h);
+
+  TrimRenderTargetPool(*graph.pool, *graph.renderer);
+}
+
+// ------------------- Damage tracking -------------------
+
+// Tracks which parts of the window changed so mostly-static screens only
+// redraw (under scissor) and present those parts.
+//
+// Redrawing less than everything is only correct if we know what the buffer
+// we're about to draw into already contains, which EGL tells us through
+// EGL_EXT_buffer_age. Without it (GLX, WGL, Cocoa, WebGL) every frame with
+// damage is a full redraw. Where EGL_KHR_swap_buffers_with_damage exists the
+// compositor is also told which rects changed.
+constexpr int kDamageHistory = 4; // frames of damage kept for buffer age
+constexpr size_t kMaxDamageRects = 8;
+
+using EGLQueryStringProc = const char *(*)(SDL_EGLDisplay, SDL_EGLint);
+using EGLQuerySurfaceProc = unsigned (*)(SDL_EGLDisplay, SDL_EGLSurface,
+                                         SDL_EGLint, SDL_EGLint *);
+using EGLSwapBuffersWithDamageProc = unsigned (*)(SDL_EGLDisplay,
+                                                  SDL_EGLSurface,
+                                                  const SDL_EGLint *,
+                                                  SDL_EGLint);
+
+struct DamageTracker {
+  std::vector<SDL_Rect> current; // damage added for the frame being built
+  std::vector<SDL_Rect> history[kDamageHistory]; // [0] = previous frame
+  bool fullDamage = true;
+  int lastWidth = 0;
+  int lastHeight = 0;
+
+  // Result of BeginDamagedFrame.
+  bool partial = false;
+  std::vector<SDL_Rect> redraw; // top-left origin, backbuffer pixels
+  SDL_Rect scissor{};           // bounds of `redraw`
+
+  SDL_EGLDisplay eglDisplay = nullptr;
+  SDL_EGLSurface eglSurface = nullptr;
+  EGLQuerySurfaceProc eglQuerySurface = nullptr; // set iff buffer age works
+  EGLSwapBuffersWithDamageProc eglSwapBuffersWithDamage = nullptr;
+  std::vector<SDL_EGLint> eglRects;
+};
+
+void InitDamageTracking(DamageTracker &damage, SDL_Window *window) {
+  damage.eglDisplay = SDL_EGL_GetCurrentDisplay();
+  damage.eglSurface = SDL_EGL_GetWindowSurface(window);
+  if (!damage.eglDisplay || !damage.eglSurface) {
+    SDL_Log("Damage tracking: not on EGL, using full redraws");
+    return;
+  }
+
+  auto queryString = reinterpret_cast<EGLQueryStringProc>(
+      SDL_EGL_GetProcAddress("eglQueryString"));
+  constexpr SDL_EGLint kEGLExtensions = 0x3055;
+  const char *extensions =
+      queryString ? queryString(damage.eglDisplay, kEGLExtensions) : nullptr;
+  const std::string_view exts = extensions ? extensions : "";
+
+  if (exts.find("EGL_EXT_buffer_age") != std::string_view::npos) {
+    damage.eglQuerySurface = reinterpret_cast<EGLQuerySurfaceProc>(
+        SDL_EGL_GetProcAddress("eglQuerySurface"));
+  }
+
+  // On Wayland SDL_GL_SwapWindow does its own frame pacing around the swap,
+  // so bypassing it would lose vsync; partial redraws still work there.
+  const char *driver = SDL_GetCurrentVideoDriver();
+  const bool wayland = driver && std::string_view(driver) == "wayland";
+  if (!wayland) {
+    for (const char *name :
+         {"eglSwapBuffersWithDamageKHR", "eglSwapBuffersWithDamageEXT"}) {
+      const std::string_view ext =
+          std::string_view(name).ends_with("KHR")
+              ? "EGL_KHR_swap_buffers_with_damage"
+              : "EGL_EXT_swap_buffers_with_damage";
+      if (exts.find(ext) != std::string_view::npos) {
+        damage.eglSwapBuffersWithDamage =
+            reinterpret_cast<EGLSwapBuffersWithDamageProc>(
+                SDL_EGL_GetProcAddress(name));
+        break;
+      }
+    }
+  }
+
+  SDL_Log("Damage tracking: buffer age %s, swap with damage %s",
+          damage.eglQuerySurface ? "yes" : "no",
+          damage.eglSwapBuffersWithDamage ? "yes" : "no");
+}
+
+static void AddRectToRegion(std::vector<SDL_Rect> &region, SDL_Rect rect) {
+  // Fold in anything the new rect overlaps so the list stays disjoint-ish.
+  for (size_t i = 0; i < region.size();) {
+    if (SDL_HasRectIntersection(&region[i], &rect)) {
+      SDL_GetRectUnion(&region[i], &rect, &rect);
+      region.erase(region.begin() + static_cast<std::ptrdiff_t>(i));
+    } else {
+      ++i;
+    }
+  }
+  region.push_back(rect);
+
+  if (region.size() > kMaxDamageRects) {
+    SDL_Rect bounds = region[0];
+    for (const SDL_Rect &r : region) {
+      SDL_GetRectUnion(&bounds, &r, &bounds);
+    }
+    region.assign(1, bounds);
+  }
+}
+
+// Marks a backbuffer-pixel rect as changed this frame.
+void AddDamage(DamageTracker &damage, const SDL_Rect &rect) {
+  if (rect.w > 0 && rect.h > 0) {
+    AddRectToRegion(damage.current, rect);
+  }
+}
+
+void AddFullDamage(DamageTracker &damage) { damage.fullDamage = true; }
+
+// Works out what has to be redrawn this frame and enables the scissor for
+// it. Returns false if nothing changed, in which case the frame should be
+// neither drawn nor presented.
+bool BeginDamagedFrame(DamageTracker &damage, SDL_Window *window) {
+  int w, h;
+  SDL_GetWindowSizeInPixels(window, &w, &h);
+  if (w != damage.lastWidth || h != damage.lastHeight) {
+    damage.fullDamage = true;
+    damage.lastWidth = w;
+    damage.lastHeight = h;
+  }
+
+  SDL_EGLint age = 0; // 0: contents unknown
+  if (damage.eglQuerySurface) {
+    constexpr SDL_EGLint kEGLBufferAge = 0x313D;
+    if (!damage.eglQuerySurface(damage.eglDisplay, damage.eglSurface,
+                                kEGLBufferAge, &age)) {
+      age = 0;
+    }
+  }
+
+  const SDL_Rect screen{0, 0, w, h};
+  damage.redraw.clear();
+  damage.partial = !damage.fullDamage && age > 0 && age <= kDamageHistory + 1;
+
+  if (!damage.partial) {
+    // If nothing changed the window still shows the right thing, whatever
+    // the age of the back buffer.
+    if (damage.fullDamage || !damage.current.empty()) {
+      damage.redraw.push_back(screen);
+    }
+  } else {
+    // The buffer is `age` frames old: it misses this frame's damage and
+    // that of the age - 1 frames before it.
+    damage.redraw = damage.current;
+    for (int i = 0; i < age - 1; ++i) {
+      for (const SDL_Rect &r : damage.history[i]) {
+        AddRectToRegion(damage.redraw, r);
+      }
+    }
+  }
+
+  if (damage.redraw.empty()) {
+    return false;
+  }
+
+  damage.scissor = damage.redraw[0];
+  for (const SDL_Rect &r : damage.redraw) {
+    SDL_GetRectUnion(&damage.scissor, &r, &damage.scissor);
+  }
+  SDL_GetRectIntersection(&damage.scissor, &screen, &damage.scissor);
+
+  if (damage.partial) {
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(damage.scissor.x, h - damage.scissor.y - damage.scissor.h,
+              damage.scissor.w, damage.scissor.h);
+  }
+  return true;
+}
+
+// Presents the frame, passing the damaged rects to the compositor where
+// supported, and rotates the damage history.
+void PresentDamagedFrame(DamageTracker &damage, SDL_Window *window) {
+  glDisable(GL_SCISSOR_TEST);
+
+  if (damage.partial && damage.eglSwapBuffersWithDamage) {
+    // EGL wants bottom-left origin x, y, w, h quadruples.
+    damage.eglRects.clear();
+    for (const SDL_Rect &r : damage.redraw) {
+      damage.eglRects.insert(damage.eglRects.end(),
+                             {r.x, damage.lastHeight - r.y - r.h, r.w, r.h});
+    }
+    damage.eglSwapBuffersWithDamage(
+        damage.eglDisplay, damage.eglSurface, damage.eglRects.data(),
+        static_cast<SDL_EGLint>(damage.redraw.size()));
+  } else {
+    EndFrame(window);
+  }
+
+  for (int i = kDamageHistory - 1; i > 0; --i) {
+    damage.history[i] = std::move(damage.history[i - 1]);
+  }
+  damage.history[0] = std::move(damage.current);
+  if (damage.fullDamage) {
+    damage.history[0].assign(1, {0, 0, damage.lastWidth, damage.lastHeight});
+  }
+  damage.current.clear();
+  damage.fullDamage = false;
+}
+
+// ------------------- Presentation modes -------------------
+
+// How the window reaches the screen. A windowed surface always goes through
+// the compositor (at least one extra frame of latency on most desktops);
+// fullscreen lets the system scan our buffers out directly, and exclusive
+// fullscreen additionally picks the display mode.
+enum class PresentMode { Windowed, Borderless, Exclusive, Count };
+
+const char *PresentModeName(PresentMode mode) {
+  switch (mode) {
+  case PresentMode::Windowed:
+    return "windowed";
+  case PresentMode::Borderless:
+    return "borderless";
+  case PresentMode::Exclusive:
+    return "exclusive";
+  default:
+    return "?";
+  }
+}
+
+// Exclusive mode request; zero fields mean "best available".
+struct DisplayModeRequest {
+  int width = 0;
+  int height = 0;
+  float refreshRate = 0.0f;
+};
+
+// Picks the fullscreen mode closest to `request`. SDL lists modes best first,
+// so with no request that is the largest size at the highest refresh rate.
+static const SDL_DisplayMode *FindDisplayMode(SDL_Window *window,
+                                              const DisplayModeRequest &request,
+                                              SDL_DisplayMode *storage) {
+  int count = 0;
+  SDL_DisplayMode **modes =
+      SDL_GetFullscreenDisplayModes(SDL_GetDisplayForWindow(window), &count);
+  if (!modes || count == 0) {
+    SDL_free(modes);
+    return nullptr;
+  }
+
+  // Lower is closer. Ties keep SDL's ordering.
+  auto distance = [&](const SDL_DisplayMode *mode) {
+    float d = 0.0f;
+    if (request.width && request.height) {
+      d += static_cast<float>(std::abs(mode->w - request.width) +
+                              std::abs(mode->h - request.height));
+    }
+    if (request.refreshRate > 0.0f) {
+      d += std::abs(mode->refresh_rate - request.refreshRate);
+    }
+    return d;
+  };
+
+  const SDL_DisplayMode *best = modes[0];
+  for (int i = 1; i < count; ++i) {
+    if (distance(modes[i]) < distance(best)) {
+      best = modes[i];
+    }
+  }
+
+  *storage = *best;
+  SDL_free(modes);
+  return storage;
+}
+
+// On success `mode` holds the mode actually applied, which differs from the
+// one asked for when exclusive fullscreen falls back to borderless.
+bool SetPresentMode(SDL_Window *window, PresentMode &mode,
+                    const DisplayModeRequest &request = {}) {
+  bool ok = true;
+  switch (mode) {
+  case PresentMode::Windowed:
+    ok = SDL_SetWindowFullscreen(window, false);
+    break;
+  case PresentMode::Borderless:
+    // nullptr selects fullscreen-desktop: no mode switch, the compositor can
+    // still hand the surface straight to the display
+    ok = SDL_SetWindowFullscreenMode(window, nullptr) &&
+         SDL_SetWindowFullscreen(window, true);
+    break;
+  case PresentMode::Exclusive: {
+    SDL_DisplayMode storage;
+    const SDL_DisplayMode *displayMode =
+        FindDisplayMode(window, request, &storage);
+    if (!displayMode) {
+      SDL_LogWarn(SDL_LOG_CATEGORY_CUSTOM,
+                  "No fullscreen display modes, using borderless");
+      mode = PresentMode::Borderless;
+      return SetPresentMode(window, mode);
+    }
+    SDL_Log("Exclusive fullscreen %ix%i@%.2fHz", displayMode->w,
+            displayMode->h, displayMode->refresh_rate);
+    ok = SDL_SetWindowFullscreenMode(window, displayMode) &&
+         SDL_SetWindowFullscreen(window, true);
+    break;
+  }
+  default:
+    return false;
+  }
+
+  if (!ok) {
+    SDL_LogError(SDL_LOG_CATEGORY_CUSTOM, "Switching to %s failed: %s",
+                 PresentModeName(mode), SDL_GetError());
+    return false;
+  }
+  SDL_SyncWindow(window);
+  return true;
+}
+
+// Time spent presenting in each mode: how long the swap call blocked, and
+// the interval between presents.
+struct PresentTiming {
+  uint64_t frames = 0;
+  double swapMsTotal = 0.0;
+  double swapMsMax = 0.0;
+  double intervalMsTotal = 0.0;
+  double gpuWaitMsTotal = 0.0; // frames-in-flight limit, see EndFrameInFlight
+  double gpuWaitMsMax = 0.0;
+  uint64_t lastPresentNS = 0;
+};
+
+void RecordPresent(PresentTiming &timing, uint64_t startNS, uint64_t endNS,
+                   uint64_t gpuWaitNS = 0) {
+  const double gpuWaitMs = static_cast<double>(gpuWaitNS) / 1e6;
+  timing.gpuWaitMsTotal += gpuWaitMs;
+  timing.gpuWaitMsMax = std::max(timing.gpuWaitMsMax, gpuWaitMs);
+  const double swapMs = static_cast<double>(endNS - startNS) / 1e6;
+  timing.swapMsTotal += swapMs;
+  timing.swapMsMax = std::max(timing.swapMsMax, swapMs);
+  if (timing.lastPresentNS) {
+    timing.intervalMsTotal +=
+        static_cast<double>(endNS - timing.lastPresentNS) / 1e6;
+  }
+  timing.lastPresentNS = endNS;
+  ++timing.frames;
+}
+
+void LogPresentTiming(PresentMode mode, const PresentTiming &timing) {
+  if (timing.frames < 2) {
+    return;
+  }
+  SDL_Log("Present timing (%s): swap avg %.2f ms, max %.2f ms, frame "
+          "interval avg %.2f ms over %llu frames",
+          PresentModeName(mode), timing.swapMsTotal / timing.frames,
+          timing.swapMsMax, timing.intervalMsTotal / (timing.frames - 1),
+          static_cast<unsigned long long>(timing.frames));
+  if (timing.gpuWaitMsMax > 0.0) {
+    SDL_Log("Waiting for frames in flight: avg %.2f ms, max %.2f ms",
+            timing.gpuWaitMsTotal / timing.frames, timing.gpuWaitMsMax);
+  }
+}
+
+// ------------------- Input latency -------------------
+
+// Measures how long input takes to reach the screen. Every input event is
+// stamped with its SDL timestamp when SDL_AppEvent sees it; the next frame
+// that is presented takes the oldest pending stamp and, when the swap
+// returns, records input-to-present. Where frames are fenced it also
+// records input-to-GPU-complete when it sees the frame's fence signalled,
+// the closest thing to present-complete feedback GL offers portably.
+constexpr size_t kLatencySamples = 4096; // per measure, oldest overwritten
+
+struct LatencySeries {
+  std::vector<float> ms;
+  size_t next = 0; // write position once full
+};
+
+struct LatencyFrame {
+  uint64_t frame = 0;
+  uint64_t inputNS = 0;
+};
+
+struct LatencyTracker {
+  uint64_t pendingInputNS = 0; // oldest input not yet taken by a frame
+  std::deque<LatencyFrame> awaitingGPU;
+  LatencySeries toPresent;
+  LatencySeries toGPUComplete;
+};
+
+bool IsInputEvent(Uint32 type) {
+  switch (type) {
+  case SDL_EVENT_KEY_DOWN:
+  case SDL_EVENT_KEY_UP:
+  case SDL_EVENT_TEXT_INPUT:
+  case SDL_EVENT_MOUSE_MOTION:
+  case SDL_EVENT_MOUSE_BUTTON_DOWN:
+  case SDL_EVENT_MOUSE_BUTTON_UP:
+  case SDL_EVENT_MOUSE_WHEEL:
+  case SDL_EVENT_FINGER_DOWN:
+  case SDL_EVENT_FINGER_UP:
+  case SDL_EVENT_FINGER_MOTION:
+    return true;
+  default:
+    return false;
+  }
+}
+
+void NoteInput(LatencyTracker &tracker, uint64_t timestampNS) {
+  if (!tracker.pendingInputNS || timestampNS < tracker.pendingInputNS) {
+    tracker.pendingInputNS = timestampNS;
+  }
+}
+
+// The input the frame about to be built responds to; 0 if none. Input taken
+// by a frame that ends up not being presented isn't measured.
+uint64_t TakeFrameInput(LatencyTracker &tracker) {
+  return std::exchange(tracker.pendingInputNS, 0);
+}
+
+static void AddLatencySample(LatencySeries &series, uint64_t fromNS,
+                             uint64_t toNS) {
+  const float ms = static_cast<float>(toNS - fromNS) / 1e6f;
+  if (series.ms.size() < kLatencySamples) {
+    series.ms.push_back(ms);
+  } else {
+    series.ms[series.next] = ms;
+    series.next = (series.next + 1) % kLatencySamples;
+  }
+}
+
+// Records a presented frame. `presentedNS` is when the swap returned.
+void RecordFrameLatency(LatencyTracker &tracker, uint64_t frame,
+                        uint64_t inputNS, uint64_t presentedNS) {
+  if (!inputNS) {
+    return;
+  }
+  AddLatencySample(tracker.toPresent, inputNS, presentedNS);
+  if (HasFrameFences()) {
+    tracker.awaitingGPU.push_back({frame, inputNS});
+  }
+}
+
+// Records input-to-GPU-complete for frames whose fence has been seen
+// signalled since the last call.
+void PollFrameLatency(LatencyTracker &tracker, const GLRenderer &renderer) {
+  const uint64_t now = SDL_GetTicksNS();
+  while (!tracker.awaitingGPU.empty() &&
+         tracker.awaitingGPU.front().frame <= renderer.completedFrame) {
+    AddLatencySample(tracker.toGPUComplete,
+                     tracker.awaitingGPU.front().inputNS, now);
+    tracker.awaitingGPU.pop_front();
+  }
+}
+
+static void LogLatencySeries(const char *name, const LatencySeries &series) {
+  if (series.ms.empty()) {
+    return;
+  }
+  std::vector<float> sorted = series.ms;
+  std::sort(sorted.begin(), sorted.end());
+  auto percentile = [&sorted](float p) {
+    return sorted[static_cast<size_t>(p * (sorted.size() - 1) + 0.5f)];
+  };
+  SDL_Log("Input to %s: p50 %.2f ms, p90 %.2f ms, p99 %.2f ms, max %.2f ms "
+          "(%zu samples)",
+          name, percentile(0.5f), percentile(0.9f), percentile(0.99f),
+          sorted.back(), sorted.size());
+}
+
+void LogLatency(const LatencyTracker &tracker) {
+  LogLatencySeries("present", tracker.toPresent);
+  LogLatencySeries("GPU complete", tracker.toGPUComplete);
+}
+
+// Starts measuring afresh, e.g. after switching present modes. Frames still
+// waiting for the GPU are dropped with the samples.
+void ResetLatency(LatencyTracker &tracker) {
+  tracker.awaitingGPU.clear();
+  tracker.toPresent = {};
+  tracker.toGPUComplete = {};
+}
+
+// --latency-test: a timer thread pushes synthetic mouse motion at an
+// interval that doesn't divide the frame time, so events land at every
+// point in the frame, until enough samples are in.
+struct LatencyTest {
+  SDL_TimerID timer = 0;
+  SDL_WindowID window = 0;
+  int samples = 0; // quit after this many input-to-present samples
+  float x = 0.0f;
+};
+
+static Uint32 SDLCALL PushSyntheticInput(void *userdata, SDL_TimerID timerID,
+                                         Uint32 interval) {
+  (void)timerID;
+  auto *test = static_cast<LatencyTest *>(userdata);
+  test->x = test->x >= 256.0f ? 0.0f : test->x + 1.0f;
+
+  SDL_Event event{};
+  event.motion.type = SDL_EVENT_MOUSE_MOTION;
+  event.motion.timestamp = SDL_GetTicksNS();
+  event.motion.windowID = test->window;
+  event.motion.x = test->x;
+  event.motion.y = 0.0f;
+  event.motion.xrel = 1.0f;
+  SDL_PushEvent(&event);
+  return interval;
+}
+
+bool StartLatencyTest(LatencyTest &test, SDL_Window *window, int samples) {
+  test.window = SDL_GetWindowID(window);
+  test.samples = std::min(samples, static_cast<int>(kLatencySamples));
+  test.timer = SDL_AddTimer(37, PushSyntheticInput, &test);
+  return test.timer != 0;
+}
+
+void StopLatencyTest(LatencyTest &test) {
+  if (test.timer) {
+    SDL_RemoveTimer(test.timer);
+    test.timer = 0;
+  }
+}
+
+// ------------------- Particles -------------------
+
+// Particles are stored as a structure of arrays so the update streams through
+// each attribute four particles at a time. The arrays are allocated once at a
+// capacity rounded up to the SIMD width, so the update may run over the last
+// partial group without bounds checks. Dead particles are swap-removed, which
+// keeps the live ones packed at the front.
+constexpr int kParticleLanes = 4;
+
+struct ParticleSystem {
+  int count = 0;
+  int capacity = 0;
+
+  std::vector<float> x, y;
+  std::vector<float> vx, vy;
+  std::vector<float> life; // seconds left
+  std::vector<float> size, sizeRate;
+  std::vector<float> r, g, b, a;     // 0..255
+  std::vector<float> dr, dg, db, da; // change per second
+
+  float gravityX = 0.0f; // pixels per second squared
+  float gravityY = 0.0f;
+  float drag = 0.0f; // fraction of velocity lost per second
+
+  uint32_t rng = 0x9E3779B9u;
+};
+
+// Every per-particle array, for operations that treat them all alike.
+static constexpr std::vector<float> ParticleSystem::*kParticleFields[] = {
+    &ParticleSystem::x,  &ParticleSystem::y,    &ParticleSystem::vx,
+    &ParticleSystem::vy, &ParticleSystem::life, &ParticleSystem::size,
+    &ParticleSystem::sizeRate, &ParticleSystem::r, &ParticleSystem::g,
+    &ParticleSystem::b,  &ParticleSystem::a,    &ParticleSystem::dr,
+    &ParticleSystem::dg, &ParticleSystem::db,   &ParticleSystem::da,
+};
+
+// Spawns particles at a point; the spawn rate is capped per frame so a long
+// frame can't produce a burst that stalls the next ones.
+struct ParticleEmitter {
+  float x = 0.0f;
+  float y = 0.0f;
+  float rate = 0.0f; // particles per second
+  int budgetPerFrame = 0;
+  float accumulator = 0.0f;
+
+  float angle = 0.0f; // radians, 0 = +x, y points down
+  float spread = 0.0f;
+  float speedMin = 0.0f, speedMax = 0.0f;
+  float lifeMin = 1.0f, lifeMax = 1.0f;
+  float size = 1.0f; // in pixels, full width
+  float sizeRate = 0.0f;
+  SDL_Color startColor{255, 255, 255, 255};
+  SDL_Color endColor{255, 255, 255, 0};
+};
+
+void InitParticleSystem(ParticleSystem &ps, int capacity) {
+  ps.capacity =
+      (capacity + kParticleLanes - 1) / kParticleLanes * kParticleLanes;
+  ps.count = 0;
+  for (auto field : kParticleFields) {
+    (ps.*field).assign(ps.capacity, 0.0f);
+  }
+}
+
+static float RandomFloat(uint32_t &state, float lo, float hi) {
+  // xorshift32
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return lo + (hi - lo) * static_cast<float>(state >> 8) * (1.0f / 16777216.0f);
+}
+
+void EmitParticles(ParticleSystem &ps, ParticleEmitter &em, float dt) {
+  em.accumulator += em.rate * dt;
+  const int wanted = static_cast<int>(em.accumulator);
+  const int spawn =
+      std::min({wanted, em.budgetPerFrame, ps.capacity - ps.count});
+  // whatever the budget cut off is dropped rather than carried over
+  em.accumulator -= static_cast<float>(wanted);
+
+  for (int n = 0; n < spawn; ++n) {
+    const int i = ps.count++;
+    const float angle =
+        em.angle + RandomFloat(ps.rng, -em.spread, em.spread);
+    const float speed = RandomFloat(ps.rng, em.speedMin, em.speedMax);
+    const float life = RandomFloat(ps.rng, em.lifeMin, em.lifeMax);
+    const float invLife = 1.0f / life;
+
+    ps.x[i] = em.x;
+    ps.y[i] = em.y;
+    ps.vx[i] = std::cos(angle) * speed;
+    ps.vy[i] = std::sin(angle) * speed;
+    ps.life[i] = life;
+    ps.size[i] = em.size;
+    ps.sizeRate[i] = em.sizeRate;
+    ps.r[i] = em.startColor.r;
+    ps.g[i] = em.startColor.g;
+    ps.b[i] = em.startColor.b;
+    ps.a[i] = em.startColor.a;
+    ps.dr[i] = (em.endColor.r - em.startColor.r) * invLife;
+    ps.dg[i] = (em.endColor.g - em.startColor.g) * invLife;
+    ps.db[i] = (em.endColor.b - em.startColor.b) * invLife;
+    ps.da[i] = (em.endColor.a - em.startColor.a) * invLife;
+  }
+}
+
+static void KillParticle(ParticleSystem &ps, int i) {
+  const int last = --ps.count;
+  for (auto field : kParticleFields) {
+    (ps.*field)[i] = (ps.*field)[last];
+  }
+}
+
+#ifdef USE_SSE2
+// value[i..i+3] += rate[i..i+3] * dt
+static inline void Integrate4(float *value, const float *rate, __m128 dt) {
+  _mm_storeu_ps(value, _mm_add_ps(_mm_loadu_ps(value),
+                                  _mm_mul_ps(_mm_loadu_ps(rate), dt)));
+}
+#endif
+
+// Advances every particle by dt seconds and removes the ones that died.
+// `simd` selects the SSE2 path where available (the scalar one is kept as
+// the reference and for benchmarking).
+void UpdateParticles(ParticleSystem &ps, float dt, bool simd = true) {
+  const float damping = std::max(0.0f, 1.0f - ps.drag * dt);
+  const float gx = ps.gravityX * dt;
+  const float gy = ps.gravityY * dt;
+
+#ifdef USE_SSE2
+  if (simd) {
+    const __m128 vdt = _mm_set1_ps(dt);
+    const __m128 vdamping = _mm_set1_ps(damping);
+    const __m128 vgx = _mm_set1_ps(gx);
+    const __m128 vgy = _mm_set1_ps(gy);
+
+    for (int i = 0; i < ps.count; i += kParticleLanes) {
+      const __m128 vx =
+          _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(&ps.vx[i]), vgx), vdamping);
+      const __m128 vy =
+          _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(&ps.vy[i]), vgy), vdamping);
+      _mm_storeu_ps(&ps.vx[i], vx);
+      _mm_storeu_ps(&ps.vy[i], vy);
+      _mm_storeu_ps(&ps.x[i],
+                    _mm_add_ps(_mm_loadu_ps(&ps.x[i]), _mm_mul_ps(vx, vdt)));
+      _mm_storeu_ps(&ps.y[i],
+                    _mm_add_ps(_mm_loadu_ps(&ps.y[i]), _mm_mul_ps(vy, vdt)));
+      _mm_storeu_ps(&ps.life[i], _mm_sub_ps(_mm_loadu_ps(&ps.life[i]), vdt));
+      Integrate4(&ps.size[i], &ps.sizeRate[i], vdt);
+      Integrate4(&ps.r[i], &ps.dr[i], vdt);
+      Integrate4(&ps.g[i], &ps.dg[i], vdt);
+      Integrate4(&ps.b[i], &ps.db[i], vdt);
+      Integrate4(&ps.a[i], &ps.da[i], vdt);
+    }
+  } else
+#endif
+  {
+    for (int i = 0; i < ps.count; ++i) {
+      ps.vx[i] = (ps.vx[i] + gx) * damping;
+      ps.vy[i] = (ps.vy[i] + gy) * damping;
+      ps.x[i] += ps.vx[i] * dt;
+      ps.y[i] += ps.vy[i] * dt;
+      ps.life[i] -= dt;
+      ps.size[i] += ps.sizeRate[i] * dt;
+      ps.r[i] += ps.dr[i] * dt;
+      ps.g[i] += ps.dg[i] * dt;
+      ps.b[i] += ps.db[i] * dt;
+      ps.a[i] += ps.da[i] * dt;
+    }
+  }
+  (void)simd;
+
+  for (int i = 0; i < ps.count;) {
+    if (ps.life[i] <= 0.0f || ps.size[i] <= 0.0f) {
+      KillParticle(ps, i); // re-check slot i, it now holds the last particle
+    } else {
+      ++i;
+    }
+  }
+}
+
+static Uint8 ToColorByte(float value) {
+  return static_cast<Uint8>(std::clamp(value, 0.0f, 255.0f));
+}
+
+// Writes one textured quad per particle straight into the renderer's batch.
+void DrawParticles(GLRenderer &renderer, const ParticleSystem &ps,
+                   const GLTexture &tex) {
+  constexpr int kQuadsPerBatch = kBatchMaxVertices / 4;
+  GLBatch &batch = renderer.batch;
+
+  for (int first = 0; first < ps.count; first += kQuadsPerBatch) {
+    const int n = std::min(kQuadsPerBatch, ps.count - first);
+    const uint16_t base = ReserveBatch(renderer, tex.id, 4 * n, 6 * n);
+
+    const size_t v0 = batch.vertices.size();
+    const size_t i0 = batch.indices.size();
+    batch.vertices.resize(v0 + 4 * static_cast<size_t>(n));
+    batch.indices.resize(i0 + 6 * static_cast<size_t>(n));
+    GLVertex *v = batch.vertices.data() + v0;
+    uint16_t *idx = batch.indices.data() + i0;
+
+    for (int k = 0; k < n; ++k) {
+      const int p = first + k;
+      const float h = ps.size[p] * 0.5f;
+      const float x0 = ps.x[p] - h, x1 = ps.x[p] + h;
+      const float y0 = ps.y[p] - h, y1 = ps.y[p] + h;
+      const SDL_Color c{ToColorByte(ps.r[p]), ToColorByte(ps.g[p]),
+                        ToColorByte(ps.b[p]), ToColorByte(ps.a[p])};
+      v[0] = {x0, y0, 0.0f, 0.0f, c};
+      v[1] = {x1, y0, 1.0f, 0.0f, c};
+      v[2] = {x1, y1, 1.0f, 1.0f, c};
+      v[3] = {x0, y1, 0.0f, 1.0f, c};
+      v += 4;
+
+      const auto q = static_cast<uint16_t>(base + 4 * k);
+      idx[0] = q;
+      idx[1] = static_cast<uint16_t>(q + 1);
+      idx[2] = static_cast<uint16_t>(q + 2);
+      idx[3] = q;
+      idx[4] = static_cast<uint16_t>(q + 2);
+      idx[5] = static_cast<uint16_t>(q + 3);
+      idx += 6;
+    }
+  }
+}
+
+// A soft white dot; particles tint it with their colour.
+GLTexture CreateParticleTexture(int size = 32) {
+  SDL_Surface *surface = SDL_CreateSurface(size, size, SDL_PIXELFORMAT_RGBA32);
+  if (!surface) {
+    SDL_LogError(SDL_LOG_CATEGORY_CUSTOM, "SDL_CreateSurface failed: %s",
+                 SDL_GetError());
+    return {};
+  }
+
+  const float radius = size * 0.5f;
+  for (int py = 0; py < size; ++py) {
+    auto *row = static_cast<uint8_t *>(surface->pixels) + py * surface->pitch;
+    for (int px = 0; px < size; ++px) {
+      const float dx = (px + 0.5f - radius) / radius;
+      const float dy = (py + 0.5f - radius) / radius;
+      const float falloff = std::max(0.0f, 1.0f - (dx * dx + dy * dy));
+      row[px * 4 + 0] = 255;
+      row[px * 4 + 1] = 255;
+      row[px * 4 + 2] = 255;
+      row[px * 4 + 3] = static_cast<uint8_t>(255.0f * falloff * falloff);
+    }
+  }
+
+  GLTexture tex = CreateTextureFromSurface(surface, TextureMips::Generate);
+  SDL_DestroySurface(surface);
+  return tex;
+}
+
+// --bench-particles: reports how many particles per millisecond the update
+// (SIMD and scalar) and the vertex output + draw get through.
+void BenchmarkParticles(GLRenderer &renderer, SDL_Window *window, int count) {
+  constexpr int kFrames = 100;
+  constexpr float kDt = 1.0f / 60.0f;
+
+  ParticleSystem ps;
+  InitParticleSystem(ps, count);
+  ps.gravityY = 100.0f;
+  ps.drag = 0.1f;
+
+  int w, h;
+  SDL_GetWindowSizeInPixels(window, &w, &h);
+  ParticleEmitter fill;
+  fill.x = w * 0.5f;
+  fill.y = h * 0.5f;
+  fill.rate = static_cast<float>(ps.capacity) / kDt;
+  fill.budgetPerFrame = ps.capacity;
+  fill.spread = SDL_PI_F;
+  fill.speedMax = 50.0f;
+  fill.lifeMin = fill.lifeMax = 1000.0f; // nothing dies while we measure
+  fill.size = 4.0f;
+  EmitParticles(ps, fill, kDt);
+
+  auto perMs = [&](uint64_t ns) {
+    return static_cast<double>(ps.count) * kFrames / (ns / 1e6);
+  };
+
+  for (const bool simd : {true, false}) {
+    const uint64_t start = SDL_GetTicksNS();
+    for (int f = 0; f < kFrames; ++f) {
+      UpdateParticles(ps, kDt, simd);
+    }
+    SDL_Log("Particles updated (%s): %.0f per ms", simd ? "SIMD" : "scalar",
+            perMs(SDL_GetTicksNS() - start));
+  }
+
+  GLTexture tex = CreateParticleTexture();
+  BeginFrame(renderer, window, 0.0f, 0.0f, 0.0f);
+  const uint64_t start = SDL_GetTicksNS();
+  for (int f = 0; f < kFrames; ++f) {
+    DrawParticles(renderer, ps, tex);
+    FlushBatch(renderer);
+  }
+  glFinish();
+  SDL_Log("Particles drawn: %.0f per ms (%d draw calls per frame)",
+          perMs(SDL_GetTicksNS() - start),
+          renderer.stats.drawCalls / kFrames);
+  DestroyTexture(tex);
+}
+
+// ------------------- Tile maps -------------------
+
+// A tile layer split into square chunks. Each chunk's quads are built once
+// into a static vertex buffer in map pixel coordinates and rebuilt only when
+// one of its tiles changes; drawing a frame binds the buffers of the chunks
+// that intersect the view and issues one draw call per chunk, offset by the
+// camera. All chunks share one index buffer, since every chunk is a list of
+// quads.
+constexpr int kChunkTiles = 32; // chunk edge length in tiles
+constexpr int kChunkMaxQuads = kChunkTiles * kChunkTiles;
+
+struct TileChunk {
+  GLuint vbo = 0;
+  int quads = 0; // non-empty tiles in the buffer
+  bool dirty = true;
+};
+
+struct TileMap {
+  int width = 0; // in tiles
+  int height = 0;
+  int tileSize = 16; // in pixels
+  std::vector<uint16_t> tiles; // 0 = empty, n = tileset entry n - 1
+
+  GLTexture tileset;
+  int tilesetColumns = 1;
+
+  int chunksX = 0;
+  int chunksY = 0;
+  std::vector<TileChunk> chunks;
+  GLuint quadIndices = 0; // shared by all chunks
+};
+
+bool CreateTileMap(TileMap &map, int width, int height, int tileSize,
+                   const GLTexture &tileset, int tilesetColumns) {
+  if (!pglGenBuffers) {
+    SDL_LogError(SDL_LOG_CATEGORY_CUSTOM, "Tile maps need buffer objects");
+    return false;
+  }
+
+  map.width = width;
+  map.height = height;
+  map.tileSize = tileSize;
+  map.tiles.assign(static_cast<size_t>(width) * height, 0);
+  map.tileset = tileset;
+  map.tilesetColumns = tilesetColumns;
+  map.chunksX = (width + kChunkTiles - 1) / kChunkTiles;
+  map.chunksY = (height + kChunkTiles - 1) / kChunkTiles;
+  map.chunks.assign(static_cast<size_t>(map.chunksX) * map.chunksY, {});
+
+  std::vector<uint16_t> indices;
+  indices.reserve(6 * kChunkMaxQuads);
+  for (int q = 0; q < kChunkMaxQuads; ++q) {
+    const auto v = static_cast<uint16_t>(4 * q);
+    indices.insert(indices.end(),
+                   {v, static_cast<uint16_t>(v + 1),
+                    static_cast<uint16_t>(v + 2), v,
+                    static_cast<uint16_t>(v + 2),
+                    static_cast<uint16_t>(v + 3)});
+  }
+  pglGenBuffers(1, &map.quadIndices);
+  pglBindBuffer(GL_ELEMENT_ARRAY_BUFFER, map.quadIndices);
+  pglBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                static_cast<std::intptr_t>(indices.size() * sizeof(uint16_t)),
+                indices.data(), GL_STATIC_DRAW);
+  pglBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  return true;
+}
+
+void SetTile(TileMap &map, int x, int y, uint16_t tile) {
+  if (x < 0 || y < 0 || x >= map.width || y >= map.height) {
+    return;
+  }
+  uint16_t &slot = map.tiles[static_cast<size_t>(y) * map.width + x];
+  if (slot != tile) {
+    slot = tile;
+    map.chunks[(y / kChunkTiles) * map.chunksX + x / kChunkTiles].dirty = true;
+  }
+}
+
+static void BuildTileChunk(TileMap &map, int cx, int cy, TileChunk &chunk,
+                           std::vector<GLVertex> &scratch) {
+  const int tilesetRows =
+      std::max(1, map.tileset.height / std::max(1, map.tileSize));
+  const float tu = 1.0f / map.tilesetColumns;
+  const float tv = 1.0f / tilesetRows;
+  // pull UVs in a little so neighbouring tiles never bleed in
+  const float insetU = 0.5f / std::max(1, map.tileset.width);
+  const float insetV = 0.5f / std::max(1, map.tileset.height);
+  const SDL_Color white{255, 255, 255, 255};
+  const float size = static_cast<float>(map.tileSize);
+
+  scratch.clear();
+  const int x1 = std::min(map.width, (cx + 1) * kChunkTiles);
+  const int y1 = std::min(map.height, (cy + 1) * kChunkTiles);
+  for (int y = cy * kChunkTiles; y < y1; ++y) {
+    for (int x = cx * kChunkTiles; x < x1; ++x) {
+      const uint16_t tile = map.tiles[static_cast<size_t>(y) * map.width + x];
+      if (tile == 0) {
+        continue;
+      }
+      const int entry = tile - 1;
+      const float u0 = (entry % map.tilesetColumns) * tu + insetU;
+      const float v0 = (entry / map.tilesetColumns) * tv + insetV;
+      const float u1 = u0 + tu - 2.0f * insetU;
+      const float v1 = v0 + tv - 2.0f * insetV;
+      const float px = x * size;
+      const float py = y * size;
+      scratch.insert(scratch.end(), {{px, py, u0, v0, white},
+                                     {px + size, py, u1, v0, white},
+                                     {px + size, py + size, u1, v1, white},
+                                     {px, py + size, u0, v1, white}});
+    }
+  }
+
+  chunk.quads = static_cast<int>(scratch.size() / 4);
+  chunk.dirty = false;
+  if (chunk.quads == 0) {
+    return;
+  }
+  if (!chunk.vbo) {
+    pglGenBuffers(1, &chunk.vbo);
+  }
+  pglBindBuffer(GL_ARRAY_BUFFER, chunk.vbo);
+  pglBufferData(GL_ARRAY_BUFFER,
+                static_cast<std::intptr_t>(scratch.size() * sizeof(GLVertex)),
+                scratch.data(), GL_STATIC_DRAW);
+}
+
+// Draws the chunks visible through a view of viewW x viewH pixels whose
+// top-left corner is at (cameraX, cameraY) in map pixels. Dirty chunks are
+// rebuilt when they come into view.
+void DrawTileMap(GLRenderer &renderer, TileMap &map, float cameraX,
+                 float cameraY, int viewW, int viewH) {
+  if (map.chunks.empty() || !map.tileset.id) {
+    return;
+  }
+  FlushBatch(renderer); // keep ordering with earlier draws
+
+  const float chunkPx = static_cast<float>(kChunkTiles * map.tileSize);
+  const int cx0 = std::max(0, static_cast<int>(std::floor(cameraX / chunkPx)));
+  const int cy0 = std::max(0, static_cast<int>(std::floor(cameraY / chunkPx)));
+  const int cx1 = std::min(
+      map.chunksX - 1,
+      static_cast<int>(std::floor((cameraX + viewW - 1) / chunkPx)));
+  const int cy1 = std::min(
+      map.chunksY - 1,
+      static_cast<int>(std::floor((cameraY + viewH - 1) / chunkPx)));
+  if (cx0 > cx1 || cy0 > cy1) {
+    return;
+  }
+
+  std::vector<GLVertex> scratch;
+  for (int cy = cy0; cy <= cy1; ++cy) {
+    for (int cx = cx0; cx <= cx1; ++cx) {
+      TileChunk &chunk = map.chunks[cy * map.chunksX + cx];
+      if (chunk.dirty) {
+        BuildTileChunk(map, cx, cy, chunk, scratch);
+      }
+    }
+  }
+
+  glBindTexture(GL_TEXTURE_2D, map.tileset.id);
+  pglBindBuffer(GL_ELEMENT_ARRAY_BUFFER, map.quadIndices);
+
+#ifdef __EMSCRIPTEN__
+  pglUseProgram(renderer.program);
+  pglUniform2f(renderer.uTranslateLoc, -cameraX, -cameraY);
+  pglEnableVertexAttribArray(renderer.aPosLoc);
+  pglEnableVertexAttribArray(renderer.aUVLoc);
+  pglEnableVertexAttribArray(renderer.aColorLoc);
+#else
+  glMatrixMode(GL_MODELVIEW);
+  glPushMatrix();
+  glTranslatef(-cameraX, -cameraY, 0.0f);
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+  glEnableClientState(GL_COLOR_ARRAY);
+#endif
+
+  for (int cy = cy0; cy <= cy1; ++cy) {
+    for (int cx = cx0; cx <= cx1; ++cx) {
+      const TileChunk &chunk = map.chunks[cy * map.chunksX + cx];
+      if (chunk.quads == 0) {
+        continue;
+      }
+      pglBindBuffer(GL_ARRAY_BUFFER, chunk.vbo);
+#ifdef __EMSCRIPTEN__
+      pglVertexAttribPointer(
+          renderer.aPosLoc, 2, GL_FLOAT, GL_FALSE, sizeof(GLVertex),
+          reinterpret_cast<const void *>(offsetof(GLVertex, x)));
+      pglVertexAttribPointer(
+          renderer.aUVLoc, 2, GL_FLOAT, GL_FALSE, sizeof(GLVertex),
+          reinterpret_cast<const void *>(offsetof(GLVertex, u)));
+      pglVertexAttribPointer(
+          renderer.aColorLoc, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(GLVertex),
+          reinterpret_cast<const void *>(offsetof(GLVertex, color)));
+      pglDrawElements(GL_TRIANGLES, 6 * chunk.quads, GL_UNSIGNED_SHORT,
+                      nullptr);
+#else
+      glVertexPointer(2, GL_FLOAT, sizeof(GLVertex),
+                      reinterpret_cast<const void *>(offsetof(GLVertex, x)));
+      glTexCoordPointer(2, GL_FLOAT, sizeof(GLVertex),
+                        reinterpret_cast<const void *>(offsetof(GLVertex, u)));
+      glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(GLVertex),
+                     reinterpret_cast<const void *>(offsetof(GLVertex, color)));
+      glDrawElements(GL_TRIANGLES, 6 * chunk.quads, GL_UNSIGNED_SHORT,
+                     nullptr);
+#endif
+      ++renderer.stats.drawCalls;
+      renderer.stats.batchedVertices += 4 * chunk.quads;
+    }
+  }
+
+#ifdef __EMSCRIPTEN__
+  pglDisableVertexAttribArray(renderer.aPosLoc);
+  pglDisableVertexAttribArray(renderer.aUVLoc);
+  pglDisableVertexAttribArray(renderer.aColorLoc);
+  pglUniform2f(renderer.uTranslateLoc, 0.0f, 0.0f);
+#else
+  glDisableClientState(GL_VERTEX_ARRAY);
+  glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+  glDisableClientState(GL_COLOR_ARRAY);
+  glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
+  glPopMatrix();
+#endif
+
+  // the batch's client-side arrays must not be read as buffer offsets
+  pglBindBuffer(GL_ARRAY_BUFFER, 0);
+  pglBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+void DestroyTileMap(GLRenderer &renderer, TileMap &map) {
+  for (TileChunk &chunk : map.chunks) {
+    RetireBuffer(renderer, chunk.vbo);
+  }
+  RetireBuffer(renderer, map.quadIndices);
+  map = {};
+}
+
+// A small procedural tileset: `columns` x `rows` tiles of flat colours with
+// a darker border, so the sample doesn't need an extra asset.
+GLTexture CreateDemoTileset(int tileSize, int columns, int rows) {
+  SDL_Surface *surface = SDL_CreateSurface(tileSize * columns, tileSize * rows,
+                                           SDL_PIXELFORMAT_RGBA32);
+  if (!surface) {
+    SDL_LogError(SDL_LOG_CATEGORY_CUSTOM, "SDL_CreateSurface failed: %s",
+                 SDL_GetError());
+    return {};
+  }
+
+  for (int t = 0; t < columns * rows; ++t) {
+    const Uint8 r = static_cast<Uint8>(60 + (t * 67) % 160);
+    const Uint8 g = static_cast<Uint8>(80 + (t * 101) % 150);
+    const Uint8 b = static_cast<Uint8>(50 + (t * 37) % 120);
+    const SDL_Rect cell{(t % columns) * tileSize, (t / columns) * tileSize,
+                        tileSize, tileSize};
+    const SDL_Rect inner{cell.x + 1, cell.y + 1, tileSize - 2, tileSize - 2};
+    SDL_FillSurfaceRect(surface, &cell,
+                        SDL_MapSurfaceRGBA(surface, r / 2, g / 2, b / 2, 255));
+    SDL_FillSurfaceRect(surface, &inner,
+                        SDL_MapSurfaceRGBA(surface, r, g, b, 255));
+  }
+
+  GLTexture tex = CreateTextureFromSurface(surface);
+  SDL_DestroySurface(surface);
+  if (tex.id) {
+    // magnify crisply; tiles are drawn at their native size
+    glBindTexture(GL_TEXTURE_2D, tex.id);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  }
+  return tex;
+}
+
+// ------------------- Glyph atlas -------------------
+
+// Printable ASCII rendered once into a single texture, so text can be drawn
+// as batched quads instead of a texture per string.
+constexpr uint32_t kFirstGlyph = 32;
+constexpr uint32_t kLastGlyph = 126;
+
+struct GlyphInfo {
+  float u0 = 0.0f, v0 = 0.0f, u1 = 0.0f, v1 = 0.0f;
+  int width = 0; // quad size in pixels
+  int height = 0;
+  int advance = 0;
+};
+
+struct GlyphAtlas {
+  GLTexture texture;
+  GlyphInfo glyphs[kLastGlyph - kFirstGlyph + 1];
+  int lineHeight = 0;
+  float whiteU = 0.0f; // a solid texel, so untextured quads share the atlas
+  float whiteV = 0.0f;
+};
+
+void DestroyGlyphAtlas(GLRenderer &renderer, GlyphAtlas &atlas) {
+  RetireTexture(renderer, atlas.texture);
+  atlas = {};
+}
+
+// (Re)builds the atlas from the font at its current size.
+bool BuildGlyphAtlas(GLRenderer &renderer, GlyphAtlas &atlas, TTF_Font *font) {
+  constexpr int kAtlasWidth = 512;
+  constexpr int kPadding = 1;
+  constexpr int kWhiteSize = 4;
+
+  SDL_Surface *glyphs[kLastGlyph - kFirstGlyph + 1] = {};
+  const SDL_Color white{255, 255, 255, 255};
+
+  // shelf-pack the glyphs left to right, after the white block
+  int x = kWhiteSize + kPadding;
+  int y = 0;
+  int shelf = kWhiteSize;
+  int positions[kLastGlyph - kFirstGlyph + 1][2] = {};
+  for (uint32_t ch = kFirstGlyph; ch <= kLastGlyph; ++ch) {
+    SDL_Surface *glyph = TTF_RenderGlyph_Blended(font, ch, white);
+    glyphs[ch - kFirstGlyph] = glyph;
+    if (!glyph) {
+      continue;
+    }
+    if (x + glyph->w > kAtlasWidth) {
+      x = 0;
+      y += shelf + kPadding;
+      shelf = 0;
+    }
+    positions[ch - kFirstGlyph][0] = x;
+    positions[ch - kFirstGlyph][1] = y;
+    x += glyph->w + kPadding;
+    shelf = std::max(shelf, glyph->h);
+  }
+
+  int height = 1;
+  while (height < y + shelf) {
+    height *= 2; // keep it mipmap- and WebGL-friendly
+  }
+
+  SDL_Surface *surface =
+      SDL_CreateSurface(kAtlasWidth, height, SDL_PIXELFORMAT_RGBA32);
+  bool ok = surface != nullptr;
+  if (ok) {
+    SDL_ClearSurface(surface, 1.0f, 1.0f, 1.0f, 0.0f);
+    const SDL_Rect whiteRect{0, 0, kWhiteSize, kWhiteSize};
+    SDL_FillSurfaceRect(surface, &whiteRect,
+                        SDL_MapSurfaceRGBA(surface, 255, 255, 255, 255));
+  }
+
+  GlyphAtlas built;
+  built.lineHeight = TTF_GetFontHeight(font);
+  built.whiteU = kWhiteSize * 0.5f / kAtlasWidth;
+  built.whiteV = kWhiteSize * 0.5f / height;
+  for (uint32_t ch = kFirstGlyph; ch <= kLastGlyph; ++ch) {
+    SDL_Surface *glyph = glyphs[ch - kFirstGlyph];
+    if (!glyph) {
+      continue;
+    }
+    if (ok) {
+      SDL_Rect dst{positions[ch - kFirstGlyph][0],
+                   positions[ch - kFirstGlyph][1], glyph->w, glyph->h};
+      SDL_SetSurfaceBlendMode(glyph, SDL_BLENDMODE_NONE);
+      SDL_BlitSurface(glyph, nullptr, surface, &dst);
+
+      GlyphInfo &info = built.glyphs[ch - kFirstGlyph];
+      info.u0 = static_cast<float>(dst.x) / kAtlasWidth;
+      info.v0 = static_cast<float>(dst.y) / height;
+      info.u1 = static_cast<float>(dst.x + dst.w) / kAtlasWidth;
+      info.v1 = static_cast<float>(dst.y + dst.h) / height;
+      info.width = glyph->w;
+      info.height = glyph->h;
+      int advance = glyph->w;
+      TTF_GetGlyphMetrics(font, ch, nullptr, nullptr, nullptr, nullptr,
+                          &advance);
+      info.advance = advance;
+    }
+    SDL_DestroySurface(glyph);
+  }
+
+  if (!ok) {
+    SDL_LogError(SDL_LOG_CATEGORY_CUSTOM, "Glyph atlas creation failed: %s",
+                 SDL_GetError());
+    return false;
+  }
+
+  built.texture = CreateTextureFromSurface(surface);
+  SDL_DestroySurface(surface);
+  if (!built.texture.id) {
+    return false;
+  }
+
+  DestroyGlyphAtlas(renderer, atlas);
+  atlas = built;
+  return true;
+}
+
+static const GlyphInfo &GetGlyph(const GlyphAtlas &atlas, char c) {
+  const auto ch = static_cast<unsigned char>(c);
+  return atlas.glyphs[(ch >= kFirstGlyph && ch <= kLastGlyph ? ch : '?') -
+                      kFirstGlyph];
+}
+
+float MeasureText(const GlyphAtlas &atlas, std::string_view text) {
+  int width = 0;
+  for (char c : text) {
+    width += GetGlyph(atlas, c).advance;
+  }
+  return static_cast<float>(width);
+}
+
+// Draws text in the atlas' glyphs with its top-left at (x, y) and returns
+// the pen position after it.
+float DrawText(GLRenderer &renderer, const GlyphAtlas &atlas,
+               std::string_view text, float x, float y, SDL_Color color) {
+  for (char c : text) {
+    const GlyphInfo &g = GetGlyph(atlas, c);
+    if (g.width > 0) {
+      DrawTextureRegion(renderer, atlas.texture, x, y,
+                        static_cast<float>(g.width),
+                        static_cast<float>(g.height), g.u0, g.v0, g.u1, g.v1,
+                        color);
+    }
+    x += g.advance;
+  }
+  return x;
+}
+
+// ------------------- Immediate-mode UI -------------------
+
+// Widgets are declared every frame inside panels and report interaction
+// immediately (a button returns true on the frame it is clicked). Drawing is
+// retained per panel: each widget only records what it would draw and mixes
+// it into the panel's hash, and the panel's vertices are regenerated only
+// when that hash differs from last frame's. Otherwise last frame's geometry
+// is copied into the batch as-is. Everything samples the glyph atlas, so the
+// whole UI is normally a single draw call.
+//
+// Coordinates are backbuffer pixels; mouse input arrives through
+// UIHandleEvent in window coordinates and is scaled by the pixel density.
+enum class UIWidgetKind : uint8_t { Label, Button, Slider };
+
+struct UIWidget {
+  UIWidgetKind kind = UIWidgetKind::Label;
+  uint8_t state = 0; // 0 idle, 1 hovered, 2 held
+  SDL_FRect rect{};
+  float fraction = 0.0f; // slider position, 0..1
+  uint32_t textOffset = 0; // into UIContext::text
+  uint32_t textLength = 0;
+};
+
+struct UIPanel {
+  uint64_t hash = 0;
+  SDL_FRect rect{};
+  std::vector<GLVertex> vertices;
+  std::vector<uint16_t> indices;
+  bool used = false; // declared this frame
+};
+
+struct UIStats {
+  int panelsReused = 0;
+  int panelsRebuilt = 0;
+};
+
+struct UIContext {
+  GlyphAtlas atlas;
+  float pixelDensity = 1.0f;
+
+  // input, in backbuffer pixels
+  float mouseX = -1.0f;
+  float mouseY = -1.0f;
+  bool mouseDown = false;
+  bool mousePressed = false; // edges since the last frame
+  bool mouseReleased = false;
+  uint64_t hotId = 0;    // widget under the mouse
+  uint64_t activeId = 0; // widget holding the mouse
+
+  // the panel being declared
+  uint64_t panelId = 0;
+  uint64_t panelHash = 0;
+  SDL_FRect panelRect{};
+  int columns = 1;
+  int column = 0;
+  float cursorY = 0.0f;
+  std::vector<UIWidget> widgets;
+  std::string text;
+
+  std::unordered_map<uint64_t, UIPanel> panels;
+  std::vector<uint64_t> drawOrder;
+  std::vector<SDL_Rect> damage; // pixels that changed since last frame
+
+  UIStats stats;
+  UIStats lastStats;
+};
+
+static uint64_t HashString(uint64_t hash, std::string_view s) {
+  return HashBytes(hash, s.data(), s.size());
+}
+
+static SDL_Rect ToPixelRect(const SDL_FRect &r) {
+  const int x = static_cast<int>(std::floor(r.x));
+  const int y = static_cast<int>(std::floor(r.y));
+  return {x, y, static_cast<int>(std::ceil(r.x + r.w)) - x,
+          static_cast<int>(std::ceil(r.y + r.h)) - y};
+}
+
+// Routes an input event to the UI. Returns true when the UI consumed it,
+// i.e. the rest of the app should ignore it.
+bool UIHandleEvent(UIContext &ui, const SDL_Event &event) {
+  auto overPanel = [&ui] {
+    const SDL_FPoint p{ui.mouseX, ui.mouseY};
+    for (uint64_t id : ui.drawOrder) {
+      if (SDL_PointInRectFloat(&p, &ui.panels[id].rect)) {
+        return true;
+      }
+    }
+    return false;
+  };
+
+  switch (event.type) {
+  case SDL_EVENT_MOUSE_MOTION:
+    ui.mouseX = event.motion.x * ui.pixelDensity;
+    ui.mouseY = event.motion.y * ui.pixelDensity;
+    return ui.activeId != 0 || overPanel();
+  case SDL_EVENT_MOUSE_BUTTON_DOWN:
+    if (event.button.button != SDL_BUTTON_LEFT) {
+      return false;
+    }
+    ui.mouseX = event.button.x * ui.pixelDensity;
+    ui.mouseY = event.button.y * ui.pixelDensity;
+    ui.mouseDown = true;
+    ui.mousePressed = true;
+    return overPanel();
+  case SDL_EVENT_MOUSE_BUTTON_UP:
+    if (event.button.button != SDL_BUTTON_LEFT) {
+      return false;
+    }
+    ui.mouseDown = false;
+    ui.mouseReleased = true;
+    return ui.activeId != 0;
+  default:
+    return false;
+  }
+}
+
+void UIBeginFrame(UIContext &ui, float pixelDensity) {
+  ui.pixelDensity = pixelDensity > 0.0f ? pixelDensity : 1.0f;
+  ui.lastStats = ui.stats;
+  ui.stats = {};
+  ui.hotId = 0;
+  ui.drawOrder.clear();
+  ui.damage.clear();
+  for (auto &[id, panel] : ui.panels) {
+    panel.used = false;
+  }
+}
+
+void UIEndFrame(UIContext &ui) {
+  // panels that weren't declared this frame disappear
+  for (auto it = ui.panels.begin(); it != ui.panels.end();) {
+    if (!it->second.used) {
+      ui.damage.push_back(ToPixelRect(it->second.rect));
+      it = ui.panels.erase(it);
+    } else {
+      ++it;
+    }
+  }
+
+  if (ui.mouseReleased) {
+    ui.activeId = 0;
+  }
+  ui.mousePressed = false;
+  ui.mouseReleased = false;
+}
+
+// Widget metrics derived from the font size.
+static float UIPadding(const UIContext &ui) {
+  return std::round(ui.atlas.lineHeight * 0.25f);
+}
+
+static float UIRowHeight(const UIContext &ui) {
+  return ui.atlas.lineHeight + 2.0f * UIPadding(ui);
+}
+
+// Starts a panel at (x, y) that is `width` pixels wide; widgets flow into
+// `columns` columns and the panel grows downwards to fit them.
+void UIBeginPanel(UIContext &ui, std::string_view name, float x, float y,
+                  float width, int columns = 1) {
+  ui.panelId = HashString(0xCBF29CE484222325ull, name);
+  ui.panelRect = {x, y, width, 0.0f};
+  ui.columns = std::max(1, columns);
+  ui.column = 0;
+  ui.cursorY = y + UIPadding(ui);
+  ui.widgets.clear();
+  ui.text.clear();
+  ui.panelHash = HashBytes(ui.panelId, &ui.panelRect, sizeof(ui.panelRect));
+}
+
+// Places the next widget and records it in the panel hash; returns its index.
+static size_t UIAddWidget(UIContext &ui, UIWidgetKind kind, uint64_t id,
+                          std::string_view text, float fraction) {
+  const float pad = UIPadding(ui);
+  const float cellW = (ui.panelRect.w - pad) / ui.columns;
+  UIWidget widget;
+  widget.kind = kind;
+  widget.rect = {ui.panelRect.x + pad + ui.column * cellW, ui.cursorY,
+                 cellW - pad, UIRowHeight(ui)};
+  if (++ui.column == ui.columns) {
+    ui.column = 0;
+    ui.cursorY += UIRowHeight(ui) + pad;
+  }
+
+  const SDL_FPoint mouse{ui.mouseX, ui.mouseY};
+  const bool hovered = SDL_PointInRectFloat(&mouse, &widget.rect) &&
+                       (ui.activeId == 0 || ui.activeId == id);
+  if (hovered && kind != UIWidgetKind::Label) {
+    ui.hotId = id;
+  }
+  widget.state = ui.activeId == id ? 2 : (hovered ? 1 : 0);
+  widget.fraction = fraction;
+  widget.textOffset = static_cast<uint32_t>(ui.text.size());
+  widget.textLength = static_cast<uint32_t>(text.size());
+  ui.text.append(text);
+
+  ui.panelHash = HashBytes(ui.panelHash, &widget.kind, sizeof(widget.kind));
+  ui.panelHash = HashBytes(ui.panelHash, &widget.state, sizeof(widget.state));
+  ui.panelHash =
+      HashBytes(ui.panelHash, &widget.fraction, sizeof(widget.fraction));
+  ui.panelHash = HashString(ui.panelHash, text);
+
+  ui.widgets.push_back(widget);
+  return ui.widgets.size() - 1;
+}
+
+void UILabel(UIContext &ui, std::string_view text) {
+  UIAddWidget(ui, UIWidgetKind::Label, 0, text, 0.0f);
+}
+
+// Returns true on the frame the button is clicked (released over it).
+bool UIButton(UIContext &ui, std::string_view label) {
+  const uint64_t id = HashString(ui.panelId, label);
+  const SDL_FPoint mouse{ui.mouseX, ui.mouseY};
+  const size_t index = UIAddWidget(ui, UIWidgetKind::Button, id, label, 0.0f);
+  const bool inside = SDL_PointInRectFloat(&mouse, &ui.widgets[index].rect);
+
+  if (ui.mousePressed && inside && ui.activeId == 0) {
+    ui.activeId = id;
+  }
+  return ui.mouseReleased && ui.activeId == id && inside;
+}
+
+// Drag to set `value` in [min, max]. Returns true when the value changed.
+bool UISlider(UIContext &ui, std::string_view label, float &value, float min,
+              float max) {
+  const uint64_t id = HashString(ui.panelId, label);
+  char text[128];
+  SDL_snprintf(text, sizeof(text), "%.*s: %.2f",
+               static_cast<int>(label.size()), label.data(), value);
+
+  // where the widget goes is only known once it is added, so interaction
+  // uses the rect it will get
+  const float fraction =
+      max > min ? std::clamp((value - min) / (max - min), 0.0f, 1.0f) : 0.0f;
+  const size_t index =
+      UIAddWidget(ui, UIWidgetKind::Slider, id, text, fraction);
+  const SDL_FRect rect = ui.widgets[index].rect;
+  const SDL_FPoint mouse{ui.mouseX, ui.mouseY};
+
+  if (ui.mousePressed && ui.activeId == 0 &&
+      SDL_PointInRectFloat(&mouse, &rect)) {
+    ui.activeId = id;
+  }
+  if (ui.activeId != id || !ui.mouseDown || rect.w <= 0.0f) {
+    return false;
+  }
+  const float t = std::clamp((ui.mouseX - rect.x) / rect.w, 0.0f, 1.0f);
+  const float next = min + t * (max - min);
+  if (next == value) {
+    return false;
+  }
+  value = next;
+  return true;
+}
+
+static void UIPushQuad(UIPanel &panel, const SDL_FRect &r, float u0, float v0,
+                       float u1, float v1, SDL_Color color) {
+  const auto base = static_cast<uint16_t>(panel.vertices.size());
+  panel.vertices.insert(panel.vertices.end(),
+                        {{r.x, r.y, u0, v0, color},
+                         {r.x + r.w, r.y, u1, v0, color},
+                         {r.x + r.w, r.y + r.h, u1, v1, color},
+                         {r.x, r.y + r.h, u0, v1, color}});
+  panel.indices.insert(panel.indices.end(),
+                       {base, static_cast<uint16_t>(base + 1),
+                        static_cast<uint16_t>(base + 2), base,
+                        static_cast<uint16_t>(base + 2),
+                        static_cast<uint16_t>(base + 3)});
+}
+
+static void UIPushSolid(UIPanel &panel, const GlyphAtlas &atlas,
+                        const SDL_FRect &r, SDL_Color color) {
+  UIPushQuad(panel, r, atlas.whiteU, atlas.whiteV, atlas.whiteU, atlas.whiteV,
+             color);
+}
+
+static void UIPushText(UIPanel &panel, const GlyphAtlas &atlas,
+                       std::string_view text, float x, float y,
+                       SDL_Color color) {
+  for (char c : text) {
+    const GlyphInfo &g = GetGlyph(atlas, c);
+    if (g.width > 0) {
+      UIPushQuad(panel,
+                 {x, y, static_cast<float>(g.width),
+                  static_cast<float>(g.height)},
+                 g.u0, g.v0, g.u1, g.v1, color);
+    }
+    x += g.advance;
+  }
+}
+
+// Regenerates a panel's geometry from the widgets declared this frame.
+static void UIBuildPanel(const UIContext &ui, UIPanel &panel) {
+  const GlyphAtlas &atlas = ui.atlas;
+  const float pad = UIPadding(ui);
+  panel.vertices.clear();
+  panel.indices.clear();
+
+  UIPushSolid(panel, atlas, panel.rect, {20, 22, 28, 220});
+  for (const UIWidget &w : ui.widgets) {
+    // each quad is 4 vertices; stop before the panel outgrows one batch
+    const size_t glyphQuads = w.textLength + 2;
+    if (panel.vertices.size() + 4 * glyphQuads > kBatchMaxVertices) {
+      SDL_LogWarn(SDL_LOG_CATEGORY_CUSTOM, "UI panel too large, truncated");
+      break;
+    }
+
+    const std::string_view text(ui.text.data() + w.textOffset, w.textLength);
+    const SDL_Color textColor{230, 230, 235, 255};
+    const float textY = w.rect.y + pad;
+    switch (w.kind) {
+    case UIWidgetKind::Label:
+      UIPushText(panel, atlas, text, w.rect.x, textY, textColor);
+      break;
+    case UIWidgetKind::Button: {
+      const Uint8 shade = w.state == 2 ? 110 : (w.state == 1 ? 85 : 60);
+      UIPushSolid(panel, atlas, w.rect,
+                  {shade, shade, static_cast<Uint8>(shade + 30), 255});
+      const float textW = MeasureText(atlas, text);
+      UIPushText(panel, atlas, text,
+                 std::round(w.rect.x + (w.rect.w - textW) * 0.5f), textY,
+                 textColor);
+      break;
+    }
+    case UIWidgetKind::Slider: {
+      const Uint8 shade = w.state != 0 ? 70 : 50;
+      UIPushSolid(panel, atlas, w.rect, {shade, shade, shade, 255});
+      UIPushSolid(panel, atlas,
+                  {w.rect.x, w.rect.y, w.rect.w * w.fraction, w.rect.h},
+                  {60, 110, 190, 255});
+      UIPushText(panel, atlas, text, w.rect.x + pad, textY, textColor);
+      break;
+    }
+    }
+  }
+}
+
+// Finishes the panel: reuses last frame's geometry if nothing it depends on
+// changed, otherwise rebuilds it and marks the old and new area damaged.
+void UIEndPanel(UIContext &ui) {
+  const float pad = UIPadding(ui);
+  const float bottom =
+      ui.cursorY + (ui.column > 0 ? UIRowHeight(ui) + pad : 0.0f);
+  ui.panelRect.h = bottom - ui.panelRect.y;
+  ui.panelHash = HashBytes(ui.panelHash, &ui.panelRect.h, sizeof(float));
+
+  UIPanel &panel = ui.panels[ui.panelId];
+  if (panel.hash == ui.panelHash && !panel.vertices.empty()) {
+    ++ui.stats.panelsReused;
+  } else {
+    if (!panel.vertices.empty()) {
+      ui.damage.push_back(ToPixelRect(panel.rect));
+    }
+    panel.hash = ui.panelHash;
+    panel.rect = ui.panelRect;
+    UIBuildPanel(ui, panel);
+    ui.damage.push_back(ToPixelRect(panel.rect));
+    ++ui.stats.panelsRebuilt;
+  }
+  panel.used = true;
+  ui.drawOrder.push_back(ui.panelId);
+}
+
+// Submits the panels declared this frame to the batch.
+void UIRender(GLRenderer &renderer, const UIContext &ui) {
+  GLBatch &batch = renderer.batch;
+  for (uint64_t id : ui.drawOrder) {
+    const UIPanel &panel = ui.panels.at(id);
+    const int vertexCount = static_cast<int>(panel.vertices.size());
+    const int indexCount = static_cast<int>(panel.indices.size());
+    const uint16_t base =
+        ReserveBatch(renderer, ui.atlas.texture.id, vertexCount, indexCount);
+
+    batch.vertices.insert(batch.vertices.end(), panel.vertices.begin(),
+                          panel.vertices.end());
+    if (base == 0) {
+      batch.indices.insert(batch.indices.end(), panel.indices.begin(),
+                           panel.indices.end());
+    } else {
+      for (uint16_t index : panel.indices) {
+        batch.indices.push_back(static_cast<uint16_t>(base + index));
+      }
+    }
+  }
+}
+
+// ------------------- Vector images -------------------
+
+// SVGs are rasterized at the pixel width they are drawn at, rounded up to a
+// size bucket so small size changes reuse an existing raster (a slightly
+// larger raster is minified through its mipmaps and stays sharp). Rasters
+// are made on a worker, kept in a small in-memory cache of textures and
+// written to a disk cache keyed by the SVG contents, so later runs skip the
+// rasterizer. Until the wanted bucket is ready the closest cached raster is
+// drawn instead.
+constexpr int kSvgMemoryRasters = 3;
+constexpr uint64_t kSvgDiskCacheBytes = 32ull << 20;
+constexpr uint64_t kSvgRetryNS = 5 * SDL_NS_PER_SECOND; // after a failure
+
+struct SvgRaster {
+  int bucketWidth = 0;
+  GLTexture texture;
+  uint64_t lastUsedNS = 0;
+};
+
+struct SvgImage {
+  std::string name; // for cache file names
+  std::shared_ptr<const std::vector<uint8_t>> source;
+  uint64_t sourceHash = 0;
+  std::string diskCacheDir; // empty: no disk cache
+
+  std::vector<SvgRaster> rasters;
+  int pendingWidth = 0;
+  std::future<SDL_Surface *> pending; // rasterizing
+  std::future<GLTexture> upload;      // pendingWidth's raster, uploading
+
+  // a bucket that failed to rasterize or upload isn't asked for again until
+  // retryNS, unless a different size is wanted in the meantime
+  int failedWidth = 0;
+  uint64_t retryNS = 0;
+};
+
+// Quarter-octave steps from 64 pixels up, rounded to multiples of 16.
+static int SvgBucketWidth(int pixels) {
+  float bucket = 64.0f;
+  while (bucket < pixels && bucket < 16384.0f) {
+    bucket *= 1.189207f; // 2^(1/4)
+  }
+  return (static_cast<int>(std::ceil(bucket)) + 15) / 16 * 16;
+}
+
+// `data`: the SVG document read from `path`. Without a `prefPath` there is
+// no disk cache.
+void LoadSvgImage(SvgImage &image, const std::filesystem::path &path,
+                  const void *data, size_t size, const std::string &prefPath) {
+  const auto *bytes = static_cast<const uint8_t *>(data);
+  image.source =
+      std::make_shared<const std::vector<uint8_t>>(bytes, bytes + size);
+
+  image.name = path.stem().string();
+  image.sourceHash =
+      HashBytes(0xCBF29CE484222325ull, image.source->data(), size);
+
+  if (!prefPath.empty()) {
+    image.diskCacheDir = prefPath + "svg-cache/";
+    if (!SDL_CreateDirectory(image.diskCacheDir.c_str())) {
+      image.diskCacheDir.clear(); // rasterize every run instead
+    }
+  }
+}
+
+// Worker side: the disk cache, or else the rasterizer (filling the cache).
+static SDL_Surface *RasterizeSvg(
+    std::shared_ptr<const std::vector<uint8_t>> source, int width,
+    std::string cachePath) {
+  if (!cachePath.empty()) {
+    if (SDL_Surface *cached = SDL_LoadBMP(cachePath.c_str())) {
+      // mark it recently used for TrimImageCache
+      std::error_code ec;
+      std::filesystem::last_write_time(
+          cachePath, std::filesystem::file_time_type::clock::now(), ec);
+      return cached;
+    }
+  }
+
+  SDL_IOStream *io = SDL_IOFromConstMem(source->data(), source->size());
+  // height 0 keeps the document's aspect ratio
+  SDL_Surface *surface = io ? IMG_LoadSizedSVG_IO(io, width, 0) : nullptr;
+  SDL_CloseIO(io);
+  if (!surface) {
+    SDL_LogError(SDL_LOG_CATEGORY_CUSTOM, "SVG rasterization failed: %s",
+                 SDL_GetError());
+    return nullptr;
+  }
+
+  // written to a temporary name first, so that a reader never sees a
+  // partial entry
+  if (!cachePath.empty()) {
+    const std::string temp = cachePath + ".tmp";
+    if (SDL_SaveBMP(surface, temp.c_str()) &&
+        SDL_RenamePath(temp.c_str(), cachePath.c_str())) {
+      TrimImageCache(std::filesystem::path(cachePath).parent_path().string(),
+                     kSvgDiskCacheBytes);
+    } else {
+      SDL_LogWarn(SDL_LOG_CATEGORY_CUSTOM, "Couldn't cache %s: %s",
+                  cachePath.c_str(), SDL_GetError());
+      SDL_RemovePath(temp.c_str());
+    }
+  }
+  return surface;
+}
+
+// Makes sure a raster for `pixelWidth` is cached or on its way. Only one
+// rasterization runs at a time; later requests wait for the next call.
+void RequestSvgSize(SvgImage &image, int pixelWidth) {
+  if (!image.source || pixelWidth <= 0 || image.pending.valid() ||
+      image.upload.valid()) {
+    return;
+  }
+  const int bucket = SvgBucketWidth(pixelWidth);
+  for (const SvgRaster &raster : image.rasters) {
+    if (raster.bucketWidth == bucket) {
+      return;
+    }
+  }
+  if (bucket == image.failedWidth && SDL_GetTicksNS() < image.retryNS) {
+    return;
+  }
+
+  std::string cachePath;
+  if (!image.diskCacheDir.empty()) {
+    char file[256];
+    SDL_snprintf(file, sizeof(file), "%s-%016llx-%d.bmp", image.name.c_str(),
+                 static_cast<unsigned long long>(image.sourceHash), bucket);
+    cachePath = image.diskCacheDir + file;
+  }
+  image.pendingWidth = bucket;
+  image.pending = std::async(kWorkerLaunch, RasterizeSvg, image.source, bucket,
+                             std::move(cachePath));
+}
+
+// Sends a finished rasterization to the uploader and collects a finished
+// upload. Returns true when a new raster arrived.
+bool PollSvgImage(SvgImage &image, GLRenderer &renderer,
+                  TextureUploader &uploader) {
+  auto failed = [&image] {
+    image.failedWidth = image.pendingWidth;
+    image.retryNS = SDL_GetTicksNS() + kSvgRetryNS;
+  };
+  if (IsReady(image.pending)) {
+    if (SDL_Surface *surface = image.pending.get()) {
+      // evicted rasters of this bucket come back at the same size
+      const GLuint reuse = AcquireTexture(renderer, surface->w, surface->h);
+      image.upload = UploadTextureAsync(uploader, surface,
+                                        TextureMips::Generate, {}, reuse);
+    } else {
+      failed();
+    }
+  }
+  if (!IsReady(image.upload)) {
+    return false;
+  }
+
+  SvgRaster raster;
+  raster.bucketWidth = image.pendingWidth;
+  raster.texture = image.upload.get();
+  raster.lastUsedNS = SDL_GetTicksNS();
+  if (!raster.texture.id) {
+    failed();
+    return false;
+  }
+
+  if (image.rasters.size() >= kSvgMemoryRasters) {
+    auto oldest = std::min_element(
+        image.rasters.begin(), image.rasters.end(),
+        [](const SvgRaster &a, const SvgRaster &b) {
+          return a.lastUsedNS < b.lastUsedNS;
+        });
+    RecycleTexture(renderer, oldest->texture);
+    image.rasters.erase(oldest);
+  }
+  image.rasters.push_back(raster);
+  return true;
+}
+
+// The raster to draw at `pixelWidth`: its bucket if cached, else the closest
+// one we have. nullptr before the first raster arrives.
+const GLTexture *BestSvgRaster(SvgImage &image, int pixelWidth) {
+  const int bucket = SvgBucketWidth(pixelWidth);
+  SvgRaster *best = nullptr;
+  for (SvgRaster &raster : image.rasters) {
+    if (!best || std::abs(raster.bucketWidth - bucket) <
+                     std::abs(best->bucketWidth - bucket)) {
+      best = &raster;
+    }
+  }
+  if (!best) {
+    return nullptr;
+  }
+  best->lastUsedNS = SDL_GetTicksNS();
+  return &best->texture;
+}
+
+void DestroySvgImage(GLRenderer &renderer, SvgImage &image) {
+  if (image.pending.valid()) {
+    SDL_DestroySurface(image.pending.get());
+  }
+  if (IsReady(image.upload)) {
+    GLTexture texture = image.upload.get();
+    RetireTexture(renderer, texture);
+  } // else the uploader cleans up when it shuts down
+  for (SvgRaster &raster : image.rasters) {
+    RetireTexture(renderer, raster.texture);
+  }
+  image = {};
+}
+
+// ------------------- Logging -------------------
+
+// A log message as captured from SDL's output function: one line, with the
+// text truncated to a fixed size so records can live in preallocated queues.
+constexpr size_t kLogTextBytes = 240;
+constexpr int kLogCategoryBuckets = 11; // SDL's named categories + custom
+
+struct LogEntry {
+  uint64_t timeNS = 0;
+  uint8_t categoryBucket = 0;
+  uint8_t priority = 0;
+  uint16_t length = 0;
+  char text[kLogTextBytes];
+};
+
+static constexpr const char *kLogCategoryNames[kLogCategoryBuckets] = {
+    "app",    "error", "assert", "system", "audio", "video",
+    "render", "input", "test",   "gpu",    "custom"};
+
+static constexpr const char *kLogPriorityNames[SDL_LOG_PRIORITY_COUNT] = {
+    "", "TRACE", "VERBOSE", "DEBUG", "INFO", "WARN", "ERROR", "CRITICAL"};
+
+static int LogCategoryBucket(int category) {
+  // reserved and custom categories share the last bucket
+  return category >= 0 && category < kLogCategoryBuckets - 1
+             ? category
+             : kLogCategoryBuckets - 1;
+}
+
+static LogEntry MakeLogEntry(int category, SDL_LogPriority priority,
+                             const char *message) {
+  LogEntry entry;
+  entry.timeNS = SDL_GetTicksNS();
+  entry.categoryBucket = static_cast<uint8_t>(LogCategoryBucket(category));
+  entry.priority = static_cast<uint8_t>(priority);
+  size_t length = 0;
+  for (; length < kLogTextBytes && message[length]; ++length) {
+    // one entry is one line
+    entry.text[length] = message[length] == '\n' ? ' ' : message[length];
+  }
+  entry.length = static_cast<uint16_t>(length);
+  return entry;
+}
+
+// SDL's default output formats and writes each message synchronously on the
+// calling thread, so a log call in per-frame code waits on stdio locks and
+// the terminal. The async logger instead copies the message into a queue
+// owned by the calling thread (single producer, single consumer, no locks)
+// and a writer thread drains all queues, writing to stderr and to a rotating
+// log file in batches. A full queue drops the message and counts it; the
+// writer reports the count. Without threads (emscripten) the queues are
+// pumped once per frame instead.
+//
+// Where SDL's own output goes somewhere stderr doesn't (logcat on Android,
+// NSLog on Apple platforms, the debugger on Windows), the writer hands every
+// line to the output function it replaced instead of writing to stderr.
+#if defined(__ANDROID__) || defined(__APPLE__) || defined(_WIN32)
+constexpr bool kChainLogOutput = true;
+#else
+constexpr bool kChainLogOutput = false;
+#endif
+constexpr size_t kLogQueueSize = 256; // per thread, power of two
+constexpr int64_t kLogFileBytes = 1 << 20;
+constexpr int kLogFiles = 3; // log.txt plus log.1.txt .. log.2.txt
+
+struct LogQueue {
+  LogEntry entries[kLogQueueSize];
+  alignas(64) std::atomic<size_t> head{0}; // next to read, writer only
+  alignas(64) std::atomic<size_t> tail{0}; // next to write, owner only
+  std::atomic<bool> owned{false};          // claimed by a live thread
+};
+
+struct AsyncLogger {
+  std::mutex queuesMutex; // guards the list, not the queues' contents
+  std::vector<std::shared_ptr<LogQueue>> queues;
+  std::atomic<uint64_t> dropped{0};
+  uint64_t droppedReported = 0;
+
+  std::string filePath; // empty: stderr only
+  SDL_IOStream *file = nullptr;
+  int64_t fileBytes = 0;
+  std::string batch; // formatted text of one drain
+
+  std::thread writer;
+  std::mutex wakeMutex;
+  std::condition_variable wake;
+  bool stopping = false; // guarded by wakeMutex
+
+  SDL_LogOutputFunction previous = nullptr;
+  void *previousUserdata = nullptr;
+};
+
+// Hands this thread's queue back when the thread exits, so short-lived
+// workers reuse queues instead of adding new ones.
+struct LogQueueHandle {
+  std::shared_ptr<LogQueue> queue;
+  const AsyncLogger *logger = nullptr;
+  ~LogQueueHandle() {
+    if (queue) {
+      queue->owned.store(false, std::memory_order_release);
+    }
+  }
+};
+
+static LogQueue *ThreadLogQueue(AsyncLogger &logger) {
+  thread_local LogQueueHandle handle;
+  if (handle.logger == &logger) {
+    return handle.queue.get();
+  }
+  if (handle.queue) {
+    handle.queue->owned.store(false, std::memory_order_release);
+  }
+
+  std::lock_guard lock(logger.queuesMutex);
+  handle.logger = &logger;
+  handle.queue = nullptr;
+  for (const auto &queue : logger.queues) {
+    bool expected = false;
+    if (queue->owned.compare_exchange_strong(expected, true,
+                                             std::memory_order_acquire)) {
+      handle.queue = queue;
+      return queue.get();
+    }
+  }
+  handle.queue = std::make_shared<LogQueue>();
+  handle.queue->owned.store(true, std::memory_order_relaxed);
+  logger.queues.push_back(handle.queue);
+  return handle.queue.get();
+}
+
+static void SDLCALL AsyncLogOutput(void *userdata, int category,
+                                   SDL_LogPriority priority,
+                                   const char *message) {
+  auto *logger = static_cast<AsyncLogger *>(userdata);
+  LogQueue *queue = ThreadLogQueue(*logger);
+
+  const size_t tail = queue->tail.load(std::memory_order_relaxed);
+  if (tail - queue->head.load(std::memory_order_acquire) == kLogQueueSize) {
+    logger->dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  queue->entries[tail & (kLogQueueSize - 1)] =
+      MakeLogEntry(category, priority, message);
+  queue->tail.store(tail + 1, std::memory_order_release);
+}
+
+static void OpenLogFile(AsyncLogger &logger) {
+  logger.file = SDL_IOFromFile(logger.filePath.c_str(), "ab");
+  const Sint64 size = logger.file ? SDL_GetIOSize(logger.file) : -1;
+  logger.fileBytes = size > 0 ? size : 0;
+}
+
+// Shifts log.txt -> log.1.txt -> ... and starts a new log.txt.
+static void RotateLogFile(AsyncLogger &logger) {
+  SDL_CloseIO(logger.file);
+  const std::string stem =
+      logger.filePath.substr(0, logger.filePath.size() - 4); // ".txt"
+  for (int i = kLogFiles - 1; i > 0; --i) {
+    const std::string from =
+        i == 1 ? logger.filePath : stem + "." + std::to_string(i - 1) + ".txt";
+    const std::string to = stem + "." + std::to_string(i) + ".txt";
+    SDL_RemovePath(to.c_str());
+    SDL_RenamePath(from.c_str(), to.c_str());
+  }
+  OpenLogFile(logger);
+}
+
+// Formats and writes everything queued so far. Writer thread only; it must
+// not log through SDL itself.
+static bool DrainAsyncLogger(AsyncLogger &logger) {
+  const bool chain = kChainLogOutput && logger.previous;
+  std::vector<std::shared_ptr<LogQueue>> queues;
+  {
+    std::lock_guard lock(logger.queuesMutex);
+    queues = logger.queues;
+  }
+
+  logger.batch.clear();
+  char line[kLogTextBytes + 64];
+  for (const auto &queue : queues) {
+    const size_t tail = queue->tail.load(std::memory_order_acquire);
+    size_t head = queue->head.load(std::memory_order_relaxed);
+    for (; head != tail; ++head) {
+      const LogEntry &e = queue->entries[head & (kLogQueueSize - 1)];
+      const int n = SDL_snprintf(
+          line, sizeof(line), "%10.3f %-8s %-6s %.*s\n", e.timeNS / 1e9,
+          kLogPriorityNames[e.priority], kLogCategoryNames[e.categoryBucket],
+          e.length, e.text);
+      logger.batch.append(line, std::min<size_t>(n, sizeof(line) - 1));
+      if (chain) {
+        // reserved and custom categories all arrive as custom
+        SDL_snprintf(line, sizeof(line), "%.*s", e.length, e.text);
+        logger.previous(logger.previousUserdata,
+                        e.categoryBucket == kLogCategoryBuckets - 1
+                            ? static_cast<int>(SDL_LOG_CATEGORY_CUSTOM)
+                            : e.categoryBucket,
+                        static_cast<SDL_LogPriority>(e.priority), line);
+      }
+    }
+    queue->head.store(head, std::memory_order_release);
+  }
+
+  const uint64_t dropped = logger.dropped.load(std::memory_order_relaxed);
+  if (dropped != logger.droppedReported) {
+    const int n = SDL_snprintf(
+        line, sizeof(line), "(%llu log messages dropped)\n",
+        static_cast<unsigned long long>(dropped - logger.droppedReported));
+    logger.batch.append(line, n);
+    logger.droppedReported = dropped;
+    if (chain) {
+      line[n - 1] = '\0'; // the output function ends the line itself
+      logger.previous(logger.previousUserdata, SDL_LOG_CATEGORY_CUSTOM,
+                      SDL_LOG_PRIORITY_WARN, line);
+    }
+  }
+
+  if (logger.batch.empty()) {
+    return false;
+  }
+  if (!chain) { // SDL's output already shows it where stderr would
+    std::fwrite(logger.batch.data(), 1, logger.batch.size(), stderr);
+  }
+  if (logger.file) {
+    if (logger.fileBytes + static_cast<int64_t>(logger.batch.size()) >
+        kLogFileBytes) {
+      RotateLogFile(logger);
+    }
+    if (logger.file) {
+      logger.fileBytes +=
+          SDL_WriteIO(logger.file, logger.batch.data(), logger.batch.size());
+    }
+  }
+  return true;
+}
+
+static void AsyncLogWriter(AsyncLogger *logger) {
+  std::unique_lock lock(logger->wakeMutex);
+  while (!logger->stopping) {
+    // callers never signal; a few milliseconds of latency is fine for logs
+    logger->wake.wait_for(lock, std::chrono::milliseconds(5));
+    lock.unlock();
+    DrainAsyncLogger(*logger);
+    lock.lock();
+  }
+}
+
+// Routes SDL log output through the logger. `logFile` may be empty to only
+// write to stderr (and the previous output, see kChainLogOutput).
+void InstallAsyncLogger(AsyncLogger &logger, std::string logFile) {
+  logger.filePath = std::move(logFile);
+  if (!logger.filePath.empty()) {
+    OpenLogFile(logger);
+  }
+  SDL_GetLogOutputFunction(&logger.previous, &logger.previousUserdata);
+  SDL_SetLogOutputFunction(AsyncLogOutput, &logger);
+#ifndef __EMSCRIPTEN__
+  logger.writer = std::thread(AsyncLogWriter, &logger);
+#endif
+}
+
+// Writes what's queued from the calling thread; for builds without a writer
+// thread.
+void PumpAsyncLogger(AsyncLogger &logger) {
+#ifdef __EMSCRIPTEN__
+  DrainAsyncLogger(logger);
+#else
+  (void)logger;
+#endif
+}
+
+// Restores the previous output and writes out everything still queued.
+// Output logged from other threads after this point is lost.
+void RemoveAsyncLogger(AsyncLogger &logger) {
+  SDL_SetLogOutputFunction(logger.previous, logger.previousUserdata);
+  if (logger.writer.joinable()) {
+    {
+      std::lock_guard lock(logger.wakeMutex);
+      logger.stopping = true;
+    }
+    logger.wake.notify_one();
+    logger.writer.join();
+  }
+  DrainAsyncLogger(logger);
+  SDL_CloseIO(logger.file);
+  logger.file = nullptr;
+}
+
+// ------------------- Log console -------------------
+
+// Everything logged through SDL is captured into a fixed-size ring that any
+// thread can push to without locks (Dmitry Vyukov's bounded MPMC queue) and
+// that the main thread drains into the console's history each frame. The
+// console only formats and draws the lines that fit on screen, so its cost
+// doesn't depend on how much history it holds.
+constexpr size_t kLogRingSize = 1024; // power of two
+constexpr size_t kConsoleHistory = 100000;
+
+struct LogRingCell {
+  std::atomic<size_t> sequence{0};
+  LogEntry entry;
+};
+
+struct LogRing {
+  LogRingCell cells[kLogRingSize];
+  alignas(64) std::atomic<size_t> enqueuePos{0};
+  alignas(64) std::atomic<size_t> dequeuePos{0};
+  std::atomic<uint64_t> dropped{0}; // pushes that found the ring full
+
+  LogRing() {
+    for (size_t i = 0; i < kLogRingSize; ++i) {
+      cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+};
+
+static bool LogRingPush(LogRing &ring, const LogEntry &entry) {
+  size_t pos = ring.enqueuePos.load(std::memory_order_relaxed);
+  for (;;) {
+    LogRingCell &cell = ring.cells[pos & (kLogRingSize - 1)];
+    const size_t seq = cell.sequence.load(std::memory_order_acquire);
+    const auto diff =
+        static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+    if (diff == 0) {
+      if (ring.enqueuePos.compare_exchange_weak(pos, pos + 1,
+                                                std::memory_order_relaxed)) {
+        cell.entry = entry;
+        cell.sequence.store(pos + 1, std::memory_order_release);
+        return true;
+      }
+    } else if (diff < 0) {
+      return false; // full
+    } else {
+      pos = ring.enqueuePos.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+static bool LogRingPop(LogRing &ring, LogEntry &out) {
+  size_t pos = ring.dequeuePos.load(std::memory_order_relaxed);
+  for (;;) {
+    LogRingCell &cell = ring.cells[pos & (kLogRingSize - 1)];
+    const size_t seq = cell.sequence.load(std::memory_order_acquire);
+    const auto diff = static_cast<std::intptr_t>(seq) -
+                      static_cast<std::intptr_t>(pos + 1);
+    if (diff == 0) {
+      if (ring.dequeuePos.compare_exchange_weak(pos, pos + 1,
+                                                std::memory_order_relaxed)) {
+        out = cell.entry;
+        cell.sequence.store(pos + kLogRingSize, std::memory_order_release);
+        return true;
+      }
+    } else if (diff < 0) {
+      return false; // empty
+    } else {
+      pos = ring.dequeuePos.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+struct LogConsole {
+  LogRing ring;
+
+  // whatever handled output before us; we pass every message on
+  SDL_LogOutputFunction next = nullptr;
+  void *nextUserdata = nullptr;
+
+  // history, oldest entries overwritten once it holds kConsoleHistory
+  std::vector<LogEntry> history;
+  uint64_t total = 0; // entries ever added; entry n lives at n % capacity
+
+  // filter and the history positions that pass it, oldest first
+  uint32_t categoryMask = (1u << kLogCategoryBuckets) - 1;
+  int filterPreset = 0; // 0 = all categories, n = only bucket n - 1
+  SDL_LogPriority minPriority = SDL_LOG_PRIORITY_VERBOSE;
+  std::deque<uint64_t> filtered;
+
+  bool open = false;
+  int scroll = 0;       // lines up from the newest
+  int rows = 1;         // log lines that fit, as of the last draw
+  bool changed = false; // needs redrawing
+};
+
+static void SDLCALL ConsoleLogOutput(void *userdata, int category,
+                                     SDL_LogPriority priority,
+                                     const char *message) {
+  auto *console = static_cast<LogConsole *>(userdata);
+  if (!LogRingPush(console->ring, MakeLogEntry(category, priority, message))) {
+    console->ring.dropped.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  if (console->next) {
+    console->next(console->nextUserdata, category, priority, message);
+  }
+}
+
+void InstallLogConsole(LogConsole &console) {
+  SDL_GetLogOutputFunction(&console.next, &console.nextUserdata);
+  SDL_SetLogOutputFunction(ConsoleLogOutput, &console);
+}
+
+void RemoveLogConsole(LogConsole &console) {
+  SDL_SetLogOutputFunction(console.next, console.nextUserdata);
+}
+
+static bool PassesLogFilter(const LogConsole &console, const LogEntry &e) {
+  return e.priority >= console.minPriority &&
+         (console.categoryMask & (1u << e.categoryBucket)) != 0;
+}
+
+static const LogEntry &LogHistoryAt(const LogConsole &console, uint64_t n) {
+  return console.history[n % kConsoleHistory];
+}
+
+// Keeps a full page of lines in view when scrolled back to the oldest.
+static void ClampLogScroll(LogConsole &console) {
+  const int count = static_cast<int>(console.filtered.size());
+  console.scroll =
+      std::clamp(console.scroll, 0, std::max(0, count - console.rows));
+}
+
+static void RebuildLogFilter(LogConsole &console) {
+  console.filtered.clear();
+  for (uint64_t n = console.total - console.history.size(); n < console.total;
+       ++n) {
+    if (PassesLogFilter(console, LogHistoryAt(console, n))) {
+      console.filtered.push_back(n);
+    }
+  }
+  console.scroll = 0;
+  console.changed = true;
+}
+
+// Moves captured messages into the history. Main thread only.
+void DrainLogConsole(LogConsole &console) {
+  LogEntry entry;
+  while (LogRingPop(console.ring, entry)) {
+    if (console.history.size() < kConsoleHistory) {
+      console.history.push_back(entry);
+    } else {
+      console.history[console.total % kConsoleHistory] = entry;
+    }
+    if (PassesLogFilter(console, entry)) {
+      console.filtered.push_back(console.total);
+      if (console.scroll > 0) {
+        ++console.scroll; // keep the view still while scrolled back
+      }
+    }
+    ++console.total;
+    console.changed |= console.open;
+  }
+
+  const uint64_t oldest = console.total - console.history.size();
+  while (!console.filtered.empty() && console.filtered.front() < oldest) {
+    console.filtered.pop_front();
+  }
+  ClampLogScroll(console);
+}
+
+// Backtick toggles the console. While open, PageUp/PageDown/Home/End and the
+// mouse wheel scroll, F1 cycles the minimum priority and F2 cycles between
+// all categories and one category at a time. Returns true if the event was
+// used.
+bool LogConsoleHandleEvent(LogConsole &console, const SDL_Event &event) {
+  if (event.type == SDL_EVENT_KEY_DOWN && event.key.key == SDLK_GRAVE) {
+    console.open = !console.open;
+    console.changed = true;
+    return true;
+  }
+  if (!console.open) {
+    return false;
+  }
+
+  if (event.type == SDL_EVENT_MOUSE_WHEEL) {
+    console.scroll += static_cast<int>(event.wheel.y * 3);
+    ClampLogScroll(console);
+    console.changed = true;
+    return true;
+  }
+  if (event.type != SDL_EVENT_KEY_DOWN) {
+    return false;
+  }
+
+  switch (event.key.key) {
+  case SDLK_PAGEUP:
+    console.scroll += 20;
+    ClampLogScroll(console);
+    break;
+  case SDLK_PAGEDOWN:
+    console.scroll = std::max(console.scroll - 20, 0);
+    break;
+  case SDLK_HOME:
+    console.scroll = static_cast<int>(console.filtered.size());
+    ClampLogScroll(console);
+    break;
+  case SDLK_END:
+    console.scroll = 0;
+    break;
+  case SDLK_F1:
+    console.minPriority = static_cast<SDL_LogPriority>(
+        console.minPriority + 1 < SDL_LOG_PRIORITY_COUNT
+            ? console.minPriority + 1
+            : SDL_LOG_PRIORITY_TRACE);
+    RebuildLogFilter(console);
+    break;
+  case SDLK_F2:
+    console.filterPreset =
+        (console.filterPreset + 1) % (kLogCategoryBuckets + 1);
+    console.categoryMask = console.filterPreset == 0
+                               ? (1u << kLogCategoryBuckets) - 1
+                               : 1u << (console.filterPreset - 1);
+    RebuildLogFilter(console);
+    break;
+  default:
+    return false;
+  }
+  console.changed = true;
+  return true;
+}
+
+// Draws the console over the top half of a w x h area, formatting only the
+// lines that are visible. Records how many fit, for scrolling.
+void DrawLogConsole(GLRenderer &renderer, LogConsole &console,
+                    const GlyphAtlas &atlas, int w, int h) {
+  if (!console.open || !atlas.texture.id || atlas.lineHeight <= 0) {
+    return;
+  }
+
+  const float lineH = static_cast<float>(atlas.lineHeight);
+  const float height = std::floor(h * 0.5f);
+  DrawTextureRegion(renderer, atlas.texture, 0.0f, 0.0f,
+                    static_cast<float>(w), height, atlas.whiteU, atlas.whiteV,
+                    atlas.whiteU, atlas.whiteV, {10, 10, 14, 230});
+
+  // status line at the bottom, log lines above it, newest last
+  char line[kLogTextBytes + 64];
+  const float statusY = height - lineH;
+  SDL_snprintf(line, sizeof(line),
+               "%s+  %s  %zu/%zu lines  %llu dropped  [F1 priority, F2 "
+               "category]",
+               kLogPriorityNames[console.minPriority],
+               console.filterPreset == 0
+                   ? "all"
+                   : kLogCategoryNames[console.filterPreset - 1],
+               console.filtered.size(), console.history.size(),
+               static_cast<unsigned long long>(
+                   console.ring.dropped.load(std::memory_order_relaxed)));
+  DrawText(renderer, atlas, line, 4.0f, statusY, {140, 200, 255, 255});
+
+  const int rows = static_cast<int>(statusY / lineH);
+  if (std::max(rows, 1) != console.rows) {
+    console.rows = std::max(rows, 1);
+    ClampLogScroll(console);
+  }
+  const int count = static_cast<int>(console.filtered.size());
+  const int last = count - 1 - console.scroll; // newest visible line
+  const int first = std::max(0, last - rows + 1);
+  float y = statusY - lineH * (last - first + 1);
+  for (int i = first; i <= last; ++i, y += lineH) {
+    const LogEntry &e = LogHistoryAt(console, console.filtered[i]);
+    SDL_Color color{220, 220, 220, 255};
+    if (e.priority >= SDL_LOG_PRIORITY_ERROR) {
+      color = {255, 110, 100, 255};
+    } else if (e.priority == SDL_LOG_PRIORITY_WARN) {
+      color = {255, 210, 90, 255};
+    } else if (e.priority < SDL_LOG_PRIORITY_INFO) {
+      color = {150, 150, 150, 255};
+    }
+    SDL_snprintf(line, sizeof(line), "%9.3f %-6s %.*s", e.timeNS / 1e9,
+                 kLogCategoryNames[e.categoryBucket], e.length, e.text);
+    DrawText(renderer, atlas, line, 4.0f, y, color);
+  }
+}
+
+// ------------------- Coroutines -------------------
+
+// App logic that spans frames (wait a second, wait for a worker, wait for
+// the next frame) can be written as a coroutine returning Task instead of a
+// hand-written state machine. Tasks are owned and resumed by a Scheduler on
+// the main thread, once per frame, until the frame's time budget is used up;
+// whatever is left over runs first on the next frame. A Task can't be
+// awaited by another Task; spawn it instead.
+struct Task {
+  struct promise_type {
+    Task get_return_object() {
+      return Task{std::coroutine_handle<promise_type>::from_promise(*this)};
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    std::suspend_always final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+
+  explicit Task(std::coroutine_handle<promise_type> h) : handle(h) {}
+  Task(Task &&other) noexcept : handle(std::exchange(other.handle, {})) {}
+  Task &operator=(Task &&) = delete;
+  ~Task() {
+    if (handle) {
+      handle.destroy(); // never spawned
+    }
+  }
+
+  std::coroutine_handle<promise_type> handle;
+};
+
+struct SchedulerStats {
+  int resumed = 0;  // coroutine resumptions
+  int deferred = 0; // ready, but pushed to the next frame by the budget
+  int tasks = 0;    // alive at the end of the frame
+  int sleeping = 0; // waiting on a Delay
+  int waiting = 0;  // waiting on a worker job
+  uint64_t timeNS = 0;
+};
+
+struct SchedulerTimer {
+  uint64_t dueNS = 0;
+  std::coroutine_handle<> handle;
+};
+
+struct SchedulerJob {
+  std::function<bool()> finished;
+  std::coroutine_handle<> handle;
+};
+
+struct Scheduler {
+  uint64_t budgetNS = SDL_MS_TO_NS(2);
+  std::vector<std::coroutine_handle<>> tasks; // everything alive
+  std::deque<std::coroutine_handle<>> ready;
+  std::vector<std::coroutine_handle<>> nextFrame;
+  std::vector<SchedulerTimer> timers; // min-heap on dueNS
+  std::vector<SchedulerJob> jobs;
+  SchedulerStats stats;     // the current frame
+  SchedulerStats lastStats; // the previous frame
+};
+
+// Starts `task` on the next RunScheduler.
+void Spawn(Scheduler &scheduler, Task task) {
+  const std::coroutine_handle<> handle = std::exchange(task.handle, {});
+  scheduler.tasks.push_back(handle);
+  scheduler.ready.push_back(handle);
+}
+
+// co_await NextFrame(s): resume on the next frame.
+struct NextFrameAwaiter {
+  Scheduler &scheduler;
+  bool await_ready() const noexcept { return false; }
+  void await_suspend(std::coroutine_handle<> handle) {
+    scheduler.nextFrame.push_back(handle);
+  }
+  void await_resume() const noexcept {}
+};
+
+NextFrameAwaiter NextFrame(Scheduler &scheduler) { return {scheduler}; }
+
+// co_await Delay(s, ns): resume on the first frame at least `ns` later.
+struct DelayAwaiter {
+  Scheduler &scheduler;
+  uint64_t dueNS;
+  bool await_ready() const noexcept { return SDL_GetTicksNS() >= dueNS; }
+  void await_suspend(std::coroutine_handle<> handle) {
+    auto later = [](const SchedulerTimer &a, const SchedulerTimer &b) {
+      return a.dueNS > b.dueNS;
+    };
+    scheduler.timers.push_back({dueNS, handle});
+    std::push_heap(scheduler.timers.begin(), scheduler.timers.end(), later);
+  }
+  void await_resume() const noexcept {}
+};
+
+DelayAwaiter Delay(Scheduler &scheduler, uint64_t ns) {
+  return {scheduler, SDL_GetTicksNS() + ns};
+}
+
+// co_await Await(s, future): resume once the future is ready and return its
+// value, e.g. an image from DecodeImageAsync.
+template <typename T> struct FutureAwaiter {
+  Scheduler &scheduler;
+  std::future<T> future;
+
+  bool Finished() const {
+    // deferred jobs (the web build) run when get() is called
+    return future.wait_for(std::chrono::seconds(0)) !=
+           std::future_status::timeout;
+  }
+  bool await_ready() const { return Finished(); }
+  void await_suspend(std::coroutine_handle<> handle) {
+    // the awaiter lives in the suspended coroutine's frame
+    scheduler.jobs.push_back({[this] { return Finished(); }, handle});
+  }
+  T await_resume() { return future.get(); }
+};
+
+template <typename T>
+FutureAwaiter<T> Await(Scheduler &scheduler, std::future<T> future) {
+  return {scheduler, std::move(future)};
+}
+
+// co_await RunOnWorker(s, fn): run fn() on a worker thread and resume with
+// its result.
+template <typename F> auto RunOnWorker(Scheduler &scheduler, F fn) {
+  return Await(scheduler, std::async(kWorkerLaunch, std::move(fn)));
+}
+
+// Resumes the tasks that can make progress this frame, oldest first, until
+// the budget is spent. At least one is resumed so a long task can't starve.
+void RunScheduler(Scheduler &scheduler) {
+  const uint64_t start = SDL_GetTicksNS();
+  scheduler.lastStats = scheduler.stats;
+  scheduler.stats = {};
+  SchedulerStats &stats = scheduler.stats;
+
+  for (std::coroutine_handle<> handle : scheduler.nextFrame) {
+    scheduler.ready.push_back(handle);
+  }
+  scheduler.nextFrame.clear();
+
+  auto later = [](const SchedulerTimer &a, const SchedulerTimer &b) {
+    return a.dueNS > b.dueNS;
+  };
+  auto &timers = scheduler.timers;
+  while (!timers.empty() && timers.front().dueNS <= start) {
+    std::pop_heap(timers.begin(), timers.end(), later);
+    scheduler.ready.push_back(timers.back().handle);
+    timers.pop_back();
+  }
+
+  auto &jobs = scheduler.jobs;
+  for (size_t i = 0; i < jobs.size();) {
+    if (jobs[i].finished()) {
+      scheduler.ready.push_back(jobs[i].handle);
+      jobs[i] = std::move(jobs.back());
+      jobs.pop_back();
+    } else {
+      ++i;
+    }
+  }
+
+  while (!scheduler.ready.empty()) {
+    if (stats.resumed > 0 && SDL_GetTicksNS() - start >= scheduler.budgetNS) {
+      break;
+    }
+    const std::coroutine_handle<> handle = scheduler.ready.front();
+    scheduler.ready.pop_front();
+    handle.resume();
+    ++stats.resumed;
+
+    if (handle.done()) {
+      auto &tasks = scheduler.tasks;
+      *std::find(tasks.begin(), tasks.end(), handle) = tasks.back();
+      tasks.pop_back();
+      handle.destroy();
+    }
+  }
+
+  stats.deferred = static_cast<int>(scheduler.ready.size());
+  stats.tasks = static_cast<int>(scheduler.tasks.size());
+  stats.sleeping = static_cast<int>(timers.size());
+  stats.waiting = static_cast<int>(jobs.size());
+  stats.timeNS = SDL_GetTicksNS() - start;
+}
+
+// Destroys every task wherever it is suspended. Tasks waiting on a worker
+// wait for that job to finish first.
+void ShutdownScheduler(Scheduler &scheduler) {
+  for (std::coroutine_handle<> handle : scheduler.tasks) {
+    handle.destroy();
+  }
+  scheduler = {};
+}
+
+// ------------------- Audio commands -------------------
+
+// MIX_* calls take the mixer's lock, which the audio thread holds while it
+// mixes, so calling them from the frame can stall it for a whole audio
+// block. Instead the main thread pushes small commands into a wait-free
+// single-producer, single-consumer ring and the mixer applies them from its
+// post-mix callback, i.e. between one block and the next: every command
+// pushed before a block boundary takes effect from the first sample of the
+// following block. A full ring drops the command and counts it rather than
+// waiting.
+constexpr size_t kAudioCommandRingSize = 64; // power of two
+
+enum class AudioCommandType : uint8_t { Play, Stop, SetGain, SetPan, Seek };
+
+struct AudioCommand {
+  AudioCommandType type = AudioCommandType::Play;
+  MIX_Track *track = nullptr;
+  float value = 0.0f; // gain, or pan from -1 (left) to 1 (right)
+  Sint64 ms = 0;      // fade length, or seek position
+  int loops = 0;      // for Play; -1 loops forever
+};
+
+struct AudioCommandQueue {
+  AudioCommand commands[kAudioCommandRingSize];
+  alignas(64) std::atomic<size_t> head{0}; // next to apply, audio thread
+  alignas(64) std::atomic<size_t> tail{0}; // next to fill, main thread
+  std::atomic<uint64_t> dropped{0};
+  MIX_Mixer *mixer = nullptr;
+};
+
+static bool PushAudioCommand(AudioCommandQueue &queue,
+                             const AudioCommand &command) {
+  const size_t tail = queue.tail.load(std::memory_order_relaxed);
+  if (tail - queue.head.load(std::memory_order_acquire) ==
+      kAudioCommandRingSize) {
+    queue.dropped.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  queue.commands[tail & (kAudioCommandRingSize - 1)] = command;
+  queue.tail.store(tail + 1, std::memory_order_release);
+  return true;
+}
+
+bool AudioPlay(AudioCommandQueue &queue, MIX_Track *track, int loops = 0,
+               Sint64 fadeInMs = 0) {
+  return PushAudioCommand(queue, {AudioCommandType::Play, track, 0.0f,
+                                  fadeInMs, loops});
+}
+
+bool AudioStop(AudioCommandQueue &queue, MIX_Track *track,
+               Sint64 fadeOutMs = 0) {
+  return PushAudioCommand(queue,
+                          {AudioCommandType::Stop, track, 0.0f, fadeOutMs});
+}
+
+bool AudioSetGain(AudioCommandQueue &queue, MIX_Track *track, float gain) {
+  return PushAudioCommand(queue, {AudioCommandType::SetGain, track, gain});
+}
+
+bool AudioSetPan(AudioCommandQueue &queue, MIX_Track *track, float pan) {
+  return PushAudioCommand(queue, {AudioCommandType::SetPan, track,
+                                  std::clamp(pan, -1.0f, 1.0f)});
+}
+
+bool AudioSeek(AudioCommandQueue &queue, MIX_Track *track, Sint64 ms) {
+  return PushAudioCommand(queue, {AudioCommandType::Seek, track, 0.0f, ms});
+}
+
+static void ApplyAudioCommand(const AudioCommand &command) {
+  MIX_Track *track = command.track;
+  switch (command.type) {
+  case AudioCommandType::Play: {
+    SDL_PropertiesID props = SDL_CreateProperties();
+    SDL_SetNumberProperty(props, MIX_PROP_PLAY_LOOPS_NUMBER, command.loops);
+    SDL_SetNumberProperty(props, MIX_PROP_PLAY_FADE_IN_FRAMES_NUMBER,
+                          MIX_TrackMSToFrames(track, command.ms));
+    MIX_PlayTrack(track, props);
+    SDL_DestroyProperties(props);
+    break;
+  }
+  case AudioCommandType::Stop:
+    MIX_StopTrack(track, MIX_TrackMSToFrames(track, command.ms));
+    break;
+  case AudioCommandType::SetGain:
+    MIX_SetTrackGain(track, command.value);
+    break;
+  case AudioCommandType::SetPan: {
+    // balance: the far side fades out, the near side stays at full gain
+    const MIX_StereoGains gains{std::min(1.0f, 1.0f - command.value),
+                                std::min(1.0f, 1.0f + command.value)};
+    MIX_SetTrackStereo(track, &gains);
+    break;
+  }
+  case AudioCommandType::Seek:
+    MIX_SetTrackPlaybackPosition(track, MIX_TrackMSToFrames(track, command.ms));
+    break;
+  }
+}
+
+// Runs on the audio thread after each mixed block, with the mixer locked.
+static void SDLCALL ApplyAudioCommands(void *userdata, MIX_Mixer *mixer,
+                                       const SDL_AudioSpec *spec, float *pcm,
+                                       int samples) {
+  (void)mixer;
+  (void)spec;
+  (void)pcm;
+  (void)samples;
+  auto *queue = static_cast<AudioCommandQueue *>(userdata);
+  const size_t tail = queue->tail.load(std::memory_order_acquire);
+  size_t head = queue->head.load(std::memory_order_relaxed);
+  for (; head != tail; ++head) {
+    ApplyAudioCommand(queue->commands[head & (kAudioCommandRingSize - 1)]);
+  }
+  queue->head.store(head, std::memory_order_release);
+}
+
+bool InstallAudioCommands(AudioCommandQueue &queue, MIX_Mixer *mixer) {
+  queue.mixer = mixer;
+  return MIX_SetPostMixCallback(mixer, ApplyAudioCommands, &queue);
+}
+
+// After this returns the audio thread no longer touches the queue.
+void RemoveAudioCommands(AudioCommandQueue &queue) {
+  if (queue.mixer) {
+    MIX_SetPostMixCallback(queue.mixer, nullptr, nullptr);
+    queue.mixer = nullptr;
+  }
+  if (const uint64_t dropped = queue.dropped.load()) {
+    SDL_LogWarn(SDL_LOG_CATEGORY_CUSTOM, "%llu audio commands dropped",
+                static_cast<unsigned long long>(dropped));
+  }
+}
+
+// ------------------- Assets -------------------
+
+// Assets are named by the AssetId values that the build generates from the
+// assets folder (scripts/generate_asset_registry.cmake), so a typo or a
+// deleted file is a compile error rather than a failed load.
+
+struct AssetPath {
+  char path[1024];
+};
+
+// Where an asset is at runtime, given the folder assets/ was packaged into
+// (with its trailing separator).
+static AssetPath LocateAsset(const char *base, AssetId id) {
+  AssetPath out;
+  SDL_snprintf(out.path, sizeof(out.path), "%s%s", base, GetAsset(id).path);
+  return out;
+}
+
+// The density variant of image `base` (name.png, name@2x.png, ...) to load
+// for drawing it at `width` x `height` pixels: the smallest that is at least
+// that big, else the biggest. Where the registry doesn't know the sizes, the
+// variants' scales are compared with `density` instead.
+static AssetId PickImageVariant(AssetId base, int width, int height,
+                                float density) {
+  AssetId best = base;
+  bool bestCovers = false;
+  uint64_t bestPixels = 0;
+  bool found = false;
+  for (size_t i = 0; i < kAssetCount; ++i) {
+    const AssetInfo &info = kAssets[i];
+    if (info.base != base) {
+      continue;
+    }
+
+    bool covers;
+    uint64_t pixels;
+    if (info.width > 0 && info.height > 0) {
+      covers = info.width >= static_cast<uint32_t>(std::max(width, 0)) &&
+               info.height >= static_cast<uint32_t>(std::max(height, 0));
+      pixels = static_cast<uint64_t>(info.width) * info.height;
+    } else {
+      covers = info.scale >= density;
+      pixels = static_cast<uint64_t>(info.scale) * info.scale;
+    }
+
+    const bool better = covers ? !bestCovers || pixels < bestPixels
+                               : !bestCovers && pixels > bestPixels;
+    if (!found || better) {
+      best = static_cast<AssetId>(i);
+      bestCovers = covers;
+      bestPixels = pixels;
+      found = true;
+    }
+  }
+  return best;
+}
+
+// The assets needed at startup are read as one batch: every read is queued
+// at once with SDL_AsyncIO (io_uring on Linux where SDL was built with it, a
+// thread pool elsewhere) into a single arena laid out from the registry's
+// sizes. Decoders then read from memory through SDL_IOFromConstMem.
+
+struct AssetSlot {
+  uint64_t offset = 0; // into AssetBatch::arena
+  uint64_t size = 0;
+  bool loaded = false;
+};
+
+struct AssetBatch {
+  // also holds up decoders still reading from it, e.g. a streaming track
+  std::shared_ptr<uint8_t[]> arena;
+  std::array<AssetSlot, kAssetCount> slots{}; // indexed by AssetId
+};
+
+// Returns false if any asset couldn't be read; the others are still usable.
+bool LoadAssetBatch(AssetBatch &batch, const char *base,
+                    const std::vector<AssetId> &ids) {
+  // back to back, aligned like the pack layout
+  uint64_t total = 0;
+  for (AssetId id : ids) {
+    AssetSlot &slot = batch.slots[static_cast<size_t>(id)];
+    slot.offset = total;
+    slot.size = GetAsset(id).size;
+    slot.loaded = false;
+    total = (total + slot.size + kAssetPackAlignment - 1) /
+            kAssetPackAlignment * kAssetPackAlignment;
+  }
+  batch.arena.reset(new uint8_t[total]);
+
+  SDL_AsyncIOQueue *queue = SDL_CreateAsyncIOQueue();
+  if (!queue) {
+    SDL_LogError(SDL_LOG_CATEGORY_CUSTOM, "SDL_CreateAsyncIOQueue failed: %s",
+                 SDL_GetError());
+    return false;
+  }
+
+  bool ok = true;
+  int pending = 0;
+  for (AssetId id : ids) {
+    AssetSlot &slot = batch.slots[static_cast<size_t>(id)];
+    const AssetPath path = LocateAsset(base, id);
+    SDL_AsyncIO *file = SDL_AsyncIOFromFile(path.path, "r");
+    if (!file) {
+      SDL_LogError(SDL_LOG_CATEGORY_CUSTOM, "Opening %s failed: %s",
+                   path.path, SDL_GetError());
+      ok = false;
+      continue;
+    }
+
+    const Sint64 size = SDL_GetAsyncIOSize(file);
+    if (size != static_cast<Sint64>(slot.size)) {
+      SDL_LogError(SDL_LOG_CATEGORY_CUSTOM,
+                   "%s is %lld bytes, but was %llu when the app was built",
+                   path.path, static_cast<long long>(size),
+                   static_cast<unsigned long long>(slot.size));
+    } else if (!SDL_ReadAsyncIO(file, batch.arena.get() + slot.offset, 0,
+                                slot.size, queue, &slot)) {
+      SDL_LogError(SDL_LOG_CATEGORY_CUSTOM, "Reading %s failed: %s",
+                   path.path, SDL_GetError());
+    } else {
+      ++pending; // closed once the read is done
+      continue;
+    }
+    ok = false;
+    if (SDL_CloseAsyncIO(file, false, queue, nullptr)) {
+      ++pending;
+    }
+  }
+
+  while (pending > 0) {
+    SDL_AsyncIOOutcome outcome;
+    if (!SDL_WaitAsyncIOResult(queue, &outcome, -1)) {
+      continue;
+    }
+    --pending;
+    if (outcome.type != SDL_ASYNCIO_TASK_READ) {
+      continue;
+    }
+
+    auto *slot = static_cast<AssetSlot *>(outcome.userdata);
+    slot->loaded = outcome.result == SDL_ASYNCIO_COMPLETE &&
+                   outcome.bytes_transferred == slot->size;
+    if (!slot->loaded) {
+      // the error, if any, was set on SDL's I/O thread, so SDL_GetError()
+      // here would be unrelated
+      static constexpr const char *kResults[] = {"complete", "failed",
+                                                 "canceled"};
+      SDL_LogError(SDL_LOG_CATEGORY_CUSTOM,
+                   "Reading %s failed: %s, %llu of %llu bytes",
+                   GetAsset(static_cast<AssetId>(slot - batch.slots.data()))
+                       .path,
+                   kResults[outcome.result],
+                   static_cast<unsigned long long>(outcome.bytes_transferred),
+                   static_cast<unsigned long long>(outcome.bytes_requested));
+      ok = false;
+    }
+    if (SDL_CloseAsyncIO(outcome.asyncio, false, queue, nullptr)) {
+      ++pending;
+    }
+  }
+  SDL_DestroyAsyncIOQueue(queue);
+  return ok;
+}
+
+// A loaded asset's bytes, sharing ownership of the arena; nullptr if it
+// wasn't loaded.
+std::shared_ptr<const void> AssetData(const AssetBatch &batch, AssetId id) {
+  const AssetSlot &slot = batch.slots[static_cast<size_t>(id)];
+  if (!slot.loaded) {
+    return nullptr;
+  }
+  return {batch.arena, batch.arena.get() + slot.offset};
+}
+
+size_t AssetSize(const AssetBatch &batch, AssetId id) {
+  return batch.slots[static_cast<size_t>(id)].size;
+}
+
+// A read-only stream over a loaded asset, for the *_IO loaders. The batch
+// must outlive it.
+SDL_IOStream *OpenAssetIO(const AssetBatch &batch, AssetId id) {
+  const AssetSlot &slot = batch.slots[static_cast<size_t>(id)];
+  if (!slot.loaded) {
+    SDL_SetError("%s wasn't loaded", GetAsset(id).path);
+    return nullptr;
+  }
+  return SDL_IOFromConstMem(batch.arena.get() + slot.offset, slot.size);
+}
+
+// ------------------- App state -------------------
+
+// Command line switches.
+struct AppOptions {
+  // --static-background: don't animate the clear colour, so frames only
+  // change where the uptime label does (shows off damage tracking)
+  bool staticBackground = false;
+
+  // --render-scale=auto|off|<fraction>
+  bool renderScaleEnabled = true;
+  float renderScaleFixed = 0.0f; // > 0: fixed scale instead of automatic
+
+  // --present=windowed|borderless|exclusive[:<w>x<h>[@<hz>]]
+  PresentMode presentMode = PresentMode::Windowed;
+  DisplayModeRequest displayMode;
+
+  // --shapes=<count>: draw that many batched shapes over the scene
+  int shapeCount = 0;
+
+  // --particles: spark and smoke effects in the scene
+  bool particles = false;
+  // --bench-particles[=<count>]: run the particle benchmark and exit
+  int benchParticles = 0;
+
+  // --tilemap: pan over a large tile map behind the image
+  bool tilemap = false;
+
+  // --ui: show the control panel; --ui-widgets=<count> adds a panel with
+  // that many buttons
+  bool ui = false;
+  int uiWidgets = 0;
+
+  // --svg: draw the vector tiger in the bottom-right corner
+  bool svg = false;
+
+  // --frames-in-flight=<1-3>: let the CPU get at most that many frames ahead
+  // of the GPU (default: up to the driver)
+  int framesInFlight = 0;
+
+  // --latency-test[=<samples>]: inject synthetic input, report input
+  // latency and quit
+  int latencyTest = 0;
+
+  // --soft-cursor: hide the system pointer and draw one that is late-latched
+  // to the newest mouse position
+  bool softCursor = false;
+
+  // --sync-uploads: upload textures on the main thread even where a shared
+  // upload context is available
+  bool uploadThread = true;
+};
+
+AppOptions ParseOptions(int argc, char *argv[]) {
+  AppOptions options;
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    if (arg == "--static-background") {
+      options.staticBackground = true;
+    } else if (arg.starts_with("--present=")) {
+      const std::string value(arg.substr(arg.find('=') + 1));
+      if (value == "borderless") {
+        options.presentMode = PresentMode::Borderless;
+      } else if (value.starts_with("exclusive")) {
+        options.presentMode = PresentMode::Exclusive;
+        DisplayModeRequest &req = options.displayMode;
+        SDL_sscanf(value.c_str(), "exclusive:%dx%d@%f", &req.width,
+                   &req.height, &req.refreshRate);
+      } else if (value != "windowed") {
+        SDL_LogWarn(SDL_LOG_CATEGORY_CUSTOM, "Unknown present mode %s",
+                    value.c_str());
+      }
+    } else if (arg.starts_with("--render-scale=")) {
+      const std::string value(arg.substr(arg.find('=') + 1));
+      if (value == "off") {
+        options.renderScaleEnabled = false;
+      } else if (value != "auto") {
+        const float scale = static_cast<float>(SDL_atof(value.c_str()));
+        options.renderScaleFixed =
+            scale > 0.0f ? std::clamp(scale, 0.1f, 1.0f) : 1.0f;
+      }
+    } else if (arg == "--svg") {
+      options.svg = true;
+    } else if (arg == "--ui") {
+      options.ui = true;
+    } else if (arg.starts_with("--ui-widgets=")) {
+      options.ui = true;
+      options.uiWidgets = std::max(0, SDL_atoi(argv[i] + arg.find('=') + 1));
+    } else if (arg == "--tilemap") {
+      options.tilemap = true;
+    } else if (arg == "--particles") {
+      options.particles = true;
+    } else if (arg == "--bench-particles") {
+      options.benchParticles = 100000;
+    } else if (arg.starts_with("--bench-particles=")) {
+      options.benchParticles =
+          std::max(1, SDL_atoi(argv[i] + arg.find('=') + 1));
+    } else if (arg.starts_with("--frames-in-flight=")) {
+      options.framesInFlight =
+          std::clamp(SDL_atoi(argv[i] + arg.find('=') + 1), 1,
+                     static_cast<int>(kAssumedFramesInFlight));
+    } else if (arg == "--latency-test") {
+      options.latencyTest = 500;
+    } else if (arg.starts_with("--latency-test=")) {
+      options.latencyTest = std::max(1, SDL_atoi(argv[i] + arg.find('=') + 1));
+    } else if (arg == "--soft-cursor") {
+      options.softCursor = true;
+    } else if (arg == "--sync-uploads") {
+      options.uploadThread = false;
+    } else if (arg.starts_with("--shapes=")) {
+      options.shapeCount = std::max(0, SDL_atoi(argv[i] + arg.find('=') + 1));
+    } else {
+      SDL_LogWarn(SDL_LOG_CATEGORY_CUSTOM, "Ignoring unknown argument %s",
+                  argv[i]);
+    }
+  }
+  return options;
+}
+
+// Where things go on screen, in backbuffer pixels. Rebuilt only when the
+// backbuffer size or the rasterized text changes, not every frame.
+struct Layout {
+  int width = 0; // backbuffer size the layout was built for
+  int height = 0;
+  SDL_FRect image{};
+  SDL_FRect message{};
+  SDL_FRect uptime{};
+  SDL_FRect vector{}; // box the SVG is fitted into
+};
+
+// While the user drags a window edge some platforms (Windows, macOS) sit in a
+// modal loop inside the event pump and SDL_AppIterate stops being called.
+// SDL still reports live-resize expose events to event watchers, so we draw
+// from there, and defer expensive work until the size stops changing.
+struct LiveResize {
+  bool active = false; // size changed within the last kResizeSettleNS
+  uint64_t lastChangeNS = 0;
+  bool rasterizePending = false; // text needs redoing once settled
+  bool inFrame = false;          // guards against re-entrant frames
+};
+
+constexpr uint64_t kResizeSettleNS = SDL_MS_TO_NS(200);
+
+// --soft-cursor state, in backbuffer pixels.
+struct SoftCursor {
+  float x = 0.0f; // as of the start of the frame
+  float y = 0.0f;
+  bool visible = false;       // pointer is over the window
+  bool globalPointer = false; // the platform reports the pointer directly
+};
+
+struct AppContext {
+  AppOptions options;
+  SDL_Window *window = nullptr;
+  GLRenderer gl;
+  DamageTracker damage;
+  PresentMode presentMode = PresentMode::Windowed;
+  PresentTiming presentTiming; // for the current mode
+  RenderTargetPool renderTargets;
+  FrameGraph frameGraph;
+  RenderScale renderScale;
+  GLTexture messageTex;
+  GLTexture imageTex;
+  TTF_Font *font = nullptr;
+  GLDynamicTexture uptimeTex;
+  SDL_Surface *uptimeCanvas = nullptr; // CPU copy of the uptime label
+  int uptimeTextWidth = 0;             // width of the text currently shown
+  uint64_t uptimeSeconds = UINT64_MAX; // value currently shown
+  uint64_t uptimeDue = UINT64_MAX;     // value to show from this frame on
+  Layout layout;
+  LiveResize resize;
+  ParticleSystem sparks;
+  ParticleSystem smoke;
+  ParticleEmitter sparkEmitter;
+  ParticleEmitter smokeEmitter;
+  GLTexture particleTex;
+  uint64_t lastUpdateNS = 0; // when the effects were last advanced
+  TileMap tilemap;
+  float tileCameraX = 0.0f;
+  float tileCameraY = 0.0f;
+  UIContext ui;
+  AsyncLogger *logger = nullptr;
+  LogConsole *console = nullptr;
+  SvgImage tiger;
+  Scheduler scheduler;
+  TextureUploader uploader;
+  LatencyTracker latency;
+  LatencyTest latencyTest;
+  SoftCursor cursor;
+  AssetBatch assets; // startup assets, read by the font and music
+  MIX_Track *track = nullptr;
+  AudioCommandQueue audio; // all playback control goes through here
+  SDL_AppResult app_quit = SDL_APP_CONTINUE;
+};
+
+// ------------------- App frame -------------------
+
+// Re-renders the uptime text into the label canvas and uploads only the part
+// of the label that changed.
+static void UpdateUptimeLabel(AppContext &app, uint64_t seconds) {
+  char text[32];
+  SDL_snprintf(text, sizeof(text), "Uptime: %02u:%02u:%02u",
+               static_cast<unsigned>(seconds / 3600),
+               static_cast<unsigned>(seconds / 60 % 60),
+               static_cast<unsigned>(seconds % 60));
+
+  SDL_Color white{255, 255, 255, 255};
+  SDL_Surface *glyphs = TTF_RenderText_Blended(app.font, text, 0, white);
+  if (!glyphs) {
+    SDL_LogError(SDL_LOG_CATEGORY_CUSTOM, "TTF_RenderText_Blended failed: %s",
+                 SDL_GetError());
+    return;
+  }
+
+  // copy the glyph pixels as-is instead of blending them onto the cleared
+  // (transparent) canvas
+  SDL_SetSurfaceBlendMode(glyphs, SDL_BLENDMODE_NONE);
+  SDL_ClearSurface(app.uptimeCanvas, 0.0f, 0.0f, 0.0f, 0.0f);
+  SDL_BlitSurface(glyphs, nullptr, app.uptimeCanvas, nullptr);
+
+  // the old text may have been wider than the new one
+  const SDL_Rect dirty{0, 0, std::max(glyphs->w, app.uptimeTextWidth),
+                       app.uptimeCanvas->h};
+  UpdateDynamicTexture(app.gl, app.uptimeTex, app.uptimeCanvas, &dirty, 1);
+
+  app.uptimeTextWidth = glyphs->w;
+  app.uptimeSeconds = seconds;
+  SDL_DestroySurface(glyphs);
+
+  SDL_LogDebug(SDL_LOG_CATEGORY_CUSTOM,
+               "Texture uploads: %llu bytes this frame, %llu last frame",
+               static_cast<unsigned long long>(app.gl.stats.textureUploadBytes),
+               static_cast<unsigned long long>(
+                   app.gl.lastStats.textureUploadBytes));
+  SDL_LogDebug(SDL_LOG_CATEGORY_CUSTOM,
+               "Last frame: %d draw calls, %d vertices, %d objects deleted, "
+               "%d textures recycled, %.2f ms waiting for the GPU, "
+               "latched %.1f px",
+               app.gl.lastStats.drawCalls, app.gl.lastStats.batchedVertices,
+               app.gl.lastStats.objectsDeleted,
+               app.gl.lastStats.texturesRecycled,
+               app.gl.lastStats.frameWaitNS / 1e6, app.gl.lastStats.latchShift);
+  const SchedulerStats &tasks = app.scheduler.lastStats;
+  SDL_LogDebug(SDL_LOG_CATEGORY_CUSTOM,
+               "Last frame: %d tasks (%d sleeping, %d on jobs), %d resumed, "
+               "%d deferred in %.3f ms",
+               tasks.tasks, tasks.sleeping, tasks.waiting, tasks.resumed,
+               tasks.deferred, tasks.timeNS / 1e6);
+  if (app.options.ui) {
+    SDL_LogDebug(SDL_LOG_CATEGORY_CUSTOM, "UI panels: %d reused, %d rebuilt",
+                 app.ui.lastStats.panelsReused, app.ui.lastStats.panelsRebuilt);
+  }
+}
+
+// (Re)creates the text textures for the window's current display scale.
+static bool RasterizeText(AppContext &app) {
+  const float displayScale = SDL_GetWindowDisplayScale(app.window);
+  const float scale = displayScale > 0.0f ? displayScale : 1.0f;
+  if (!TTF_SetFontSize(app.font, fontSize * scale)) {
+    SDL_Fail();
+    return false;
   }
 
   // render the font to a surface
   const std::string_view text = "Hello SDL!";
   SDL_Color white{255, 255, 255, 255};
   SDL_Surface *surfaceMessage =
-      TTF_RenderText_Solid(font, text.data(), text.length(), white);
-
+      TTF_RenderText_Solid(app.font, text.data(), text.length(), white);
   if (!surfaceMessage) {
-    TTF_CloseFont(font);
+    SDL_Fail();
+    return false;
+  }
+
+  // make an OpenGL texture from the surface; we no longer need the surface
+  // after that
+  RetireTexture(app.gl, app.messageTex);
+  app.messageTex = CreateTextureFromSurface(surfaceMessage);
+  SDL_DestroySurface(surfaceMessage);
+  if (!app.messageTex.id) {
+    return false;
+  }
+
+  // the uptime label changes every second, so it lives in a dynamic texture
+  // sized for the widest text it will show
+  constexpr std::string_view widestUptime = "Uptime: 00:00:00";
+  int uptimeW = 0, uptimeH = 0;
+  if (!TTF_GetStringSize(app.font, widestUptime.data(), widestUptime.length(),
+                         &uptimeW, &uptimeH)) {
+    SDL_Fail();
+    return false;
+  }
+  uptimeW += uptimeH; // slack for proportional digits
+
+  DestroyDynamicTexture(app.gl, app.uptimeTex);
+  SDL_DestroySurface(app.uptimeCanvas);
+  app.uptimeCanvas = SDL_CreateSurface(uptimeW, uptimeH, SDL_PIXELFORMAT_RGBA32);
+  app.uptimeTex = CreateDynamicTexture(uptimeW, uptimeH);
+  if (!app.uptimeCanvas || !app.uptimeTex.slots[0].id) {
+    SDL_Fail();
+    return false;
+  }
+
+  // the UI and the log console use their own, smaller size
+  const bool built = TTF_SetFontSize(app.font, uiFontSize * scale) &&
+                     BuildGlyphAtlas(app.gl, app.ui.atlas, app.font);
+  TTF_SetFontSize(app.font, fontSize * scale);
+  if (!built) {
+    return false;
+  }
+  app.ui.panels.clear(); // built from the old glyphs
+
+  // redraw the label and place everything again on the next frame
+  app.uptimeTextWidth = 0;
+  app.uptimeSeconds = UINT64_MAX;
+  app.layout.width = 0;
+  return true;
+}
+
+static void UpdateLayout(AppContext &app, int width, int height) {
+  Layout &layout = app.layout;
+  if (layout.width == width && layout.height == height) {
+    return;
+  }
+  layout.width = width;
+  layout.height = height;
+
+  // image covers the window, text in the top-left corner
+  layout.image = {0.0f, 0.0f, static_cast<float>(width),
+                  static_cast<float>(height)};
+  layout.message = {0.0f, 0.0f, static_cast<float>(app.messageTex.width),
+                    static_cast<float>(app.messageTex.height)};
+  const GLTexture &uptimeTex = DynamicTextureFront(app.uptimeTex);
+  layout.uptime = {0.0f, layout.message.h, static_cast<float>(uptimeTex.width),
+                   static_cast<float>(uptimeTex.height)};
+
+  // vector art in the bottom-right corner, a third of the smaller side
+  const float side = std::round(std::min(width, height) / 3.0f);
+  layout.vector = {width - side, height - side, side, side};
+}
+
+// Where the uptime label is drawn, in backbuffer pixels.
+static SDL_Rect UptimeLabelRect(const AppContext &app) {
+  const SDL_FRect &r = app.layout.uptime;
+  return {static_cast<int>(r.x), static_cast<int>(r.y), static_cast<int>(r.w),
+          static_cast<int>(r.h)};
+}
+
+// Reads the pointer straight from the window system where SDL can, which is
+// newer than the last motion event. Elsewhere (Wayland, browsers) the pointer
+// is only known from events, so this is where the last event pump left it.
+static bool SampleLatestPointer(void *userdata, float *x, float *y) {
+  auto *app = static_cast<AppContext *>(userdata);
+  float px, py;
+  SDL_GetMouseState(&px, &py);
+#ifndef __EMSCRIPTEN__
+  int wx, wy;
+  if (app->cursor.globalPointer &&
+      SDL_GetWindowPosition(app->window, &wx, &wy)) {
+    SDL_GetGlobalMouseState(&px, &py);
+    px -= static_cast<float>(wx);
+    py -= static_cast<float>(wy);
+  }
+#endif
+  const float density = SDL_GetWindowPixelDensity(app->window);
+  *x = px * density;
+  *y = py * density;
+  return true;
+}
+
+// Takes the frame-start pointer position. Returns true when the cursor moved,
+// appeared or disappeared.
+static bool UpdateSoftCursor(AppContext &app) {
+  SoftCursor &cursor = app.cursor;
+  float x, y;
+  SDL_GetMouseState(&x, &y);
+  const float density = SDL_GetWindowPixelDensity(app.window);
+  x *= density;
+  y *= density;
+  const bool visible = SDL_GetMouseFocus() == app.window;
+
+  const bool moved = x != cursor.x || y != cursor.y;
+  const bool changed = visible != cursor.visible || (visible && moved);
+  cursor.x = x;
+  cursor.y = y;
+  cursor.visible = visible;
+  return changed;
+}
+
+// Crosshair centred on (x, y), white with a dark outline so it shows on any
+// background.
+static void DrawSoftCursor(GLRenderer &renderer, float x, float y,
+                           float scale) {
+  const float arm = 10.0f * scale;
+  const float half = 1.0f * scale; // half the line width
+  const float edge = 1.0f * scale;
+  const SDL_FRect bars[2] = {{x - arm, y - half, 2.0f * arm, 2.0f * half},
+                             {x - half, y - arm, 2.0f * half, 2.0f * arm}};
+  for (const SDL_FRect &r : bars) {
+    FillRect(renderer,
+             {r.x - edge, r.y - edge, r.w + 2.0f * edge, r.h + 2.0f * edge},
+             {0, 0, 0, 200});
+  }
+  for (const SDL_FRect &r : bars) {
+    FillRect(renderer, r, {255, 255, 255, 255});
+  }
+}
+
+static void InitEffects(AppContext &app) {
+  app.particleTex = CreateParticleTexture();
+
+  InitParticleSystem(app.sparks, 20000);
+  app.sparks.gravityY = 900.0f;
+  app.sparks.drag = 0.5f;
+  ParticleEmitter &sparks = app.sparkEmitter;
+  sparks.rate = 4000.0f;
+  sparks.budgetPerFrame = 400;
+  sparks.angle = -SDL_PI_F * 0.5f;
+  sparks.spread = 0.5f;
+  sparks.speedMin = 300.0f;
+  sparks.speedMax = 700.0f;
+  sparks.lifeMin = 0.6f;
+  sparks.lifeMax = 1.4f;
+  sparks.size = 6.0f;
+  sparks.sizeRate = -3.0f;
+  sparks.startColor = {255, 230, 140, 255};
+  sparks.endColor = {255, 60, 0, 0};
+
+  InitParticleSystem(app.smoke, 10000);
+  app.smoke.gravityY = -60.0f;
+  app.smoke.drag = 0.8f;
+  ParticleEmitter &smoke = app.smokeEmitter;
+  smoke.rate = 600.0f;
+  smoke.budgetPerFrame = 60;
+  smoke.angle = -SDL_PI_F * 0.5f;
+  smoke.spread = 0.3f;
+  smoke.speedMin = 40.0f;
+  smoke.speedMax = 120.0f;
+  smoke.lifeMin = 2.0f;
+  smoke.lifeMax = 4.0f;
+  smoke.size = 24.0f;
+  smoke.sizeRate = 40.0f;
+  smoke.startColor = {90, 90, 90, 160};
+  smoke.endColor = {160, 160, 160, 0};
+}
+
+// Declares this frame's UI and marks what it changed as damaged.
+static void BuildUI(AppContext &app, int w) {
+  UIContext &ui = app.ui;
+  UIBeginFrame(ui, SDL_GetWindowPixelDensity(app.window));
+
+  const float margin = std::round(10.0f * ui.pixelDensity);
+  const float width = std::round(260.0f * ui.pixelDensity);
+  UIBeginPanel(ui, "controls", w - width - margin, margin, width);
+
+  RenderScale &rs = app.renderScale;
+  if (rs.enabled) {
+    float scale = rs.scale;
+    if (UISlider(ui, "Render scale", scale, rs.minScale, rs.maxScale)) {
+      rs.scale = scale;
+      rs.automatic = false;
+    }
+    if (UIButton(ui, rs.automatic ? "Automatic scale: on"
+                                  : "Automatic scale: off")) {
+      rs.automatic = !rs.automatic;
+      rs.cooldownFrames = 0;
+    }
+  }
+  if (UIButton(ui, app.options.particles ? "Particles: on" : "Particles: off")) {
+    if (!app.particleTex.id) {
+      InitEffects(app);
+    }
+    app.options.particles = !app.options.particles;
+  }
+
+  char line[64];
+  SDL_snprintf(line, sizeof(line), "%d draw calls", app.gl.lastStats.drawCalls);
+  UILabel(ui, line);
+  UIEndPanel(ui);
+
+  if (app.options.uiWidgets > 0) {
+    const float gridWidth = std::round(600.0f * ui.pixelDensity);
+    UIBeginPanel(ui, "widgets", margin, 4.0f * margin, gridWidth, 6);
+    for (int i = 0; i < app.options.uiWidgets; ++i) {
+      SDL_snprintf(line, sizeof(line), "Button %d", i);
+      if (UIButton(ui, line)) {
+        SDL_Log("%s clicked", line);
+      }
+    }
+    UIEndPanel(ui);
+  }
+
+  UIEndFrame(ui);
+  for (const SDL_Rect &r : ui.damage) {
+    AddDamage(app.damage, r);
+  }
+}
+
+// A 1000x1000 tile map of procedural terrain.
+static bool InitTileMapDemo(AppContext &app) {
+  constexpr int kTileSize = 16;
+  constexpr int kColumns = 4;
+  constexpr int kRows = 4;
+  constexpr int kMapTiles = 1000;
+
+  GLTexture tileset = CreateDemoTileset(kTileSize, kColumns, kRows);
+  if (!tileset.id ||
+      !CreateTileMap(app.tilemap, kMapTiles, kMapTiles, kTileSize, tileset,
+                     kColumns)) {
+    DestroyTexture(tileset);
+    return false;
+  }
+
+  for (int y = 0; y < kMapTiles; ++y) {
+    for (int x = 0; x < kMapTiles; ++x) {
+      const float height = std::sin(x * 0.031f) + std::cos(y * 0.027f) +
+                           0.5f * std::sin((x + y) * 0.11f);
+      const int band = static_cast<int>((height + 2.5f) * 3.0f);
+      SetTile(app.tilemap, x, y,
+              static_cast<uint16_t>(1 + std::clamp(band, 0, 15)));
+    }
+  }
+  return true;
+}
+
+// Pans the tile map camera.
+static void UpdateTileMapDemo(AppContext &app, int w, int h) {
+  const TileMap &map = app.tilemap;
+  const float time = SDL_GetTicks() / 1000.0f;
+  const float rangeX = std::max(0.0f, map.width * map.tileSize - w * 1.0f);
+  const float rangeY = std::max(0.0f, map.height * map.tileSize - h * 1.0f);
+  app.tileCameraX = (std::sin(time * 0.05f) + 1.0f) * 0.5f * rangeX;
+  app.tileCameraY = (std::cos(time * 0.04f) + 1.0f) * 0.5f * rangeY;
+}
+
+// Once a second, changes the tile under the middle of the window so one
+// chunk gets rebuilt.
+static Task TileMapTickLoop(AppContext &app) {
+  for (;;) {
+    co_await Delay(app.scheduler, SDL_NS_PER_SECOND);
+    const TileMap &map = app.tilemap;
+    const int tx = static_cast<int>(
+        (app.tileCameraX + app.layout.width * 0.5f) / map.tileSize);
+    const int ty = static_cast<int>(
+        (app.tileCameraY + app.layout.height * 0.5f) / map.tileSize);
+    SetTile(app.tilemap, tx, ty,
+            static_cast<uint16_t>(1 + SDL_GetTicks() / 1000 % 16));
+  }
+}
+
+// Marks the uptime label for redrawing on every second boundary. The frame
+// does the upload, after BeginFrame, so it counts towards that frame's stats.
+static Task UptimeLabelLoop(AppContext &app) {
+  for (;;) {
+    const uint64_t now = SDL_GetTicksNS();
+    const uint64_t seconds = now / SDL_NS_PER_SECOND;
+    if (seconds != app.uptimeDue) {
+      app.uptimeDue = seconds;
+      AddDamage(app.damage, UptimeLabelRect(app));
+    }
+    co_await Delay(app.scheduler, (seconds + 1) * SDL_NS_PER_SECOND - now);
+  }
+}
+
+// Moves the effects to the bottom of the window and advances them.
+static void UpdateEffects(AppContext &app, int w, int h) {
+  const uint64_t now = SDL_GetTicksNS();
+  // don't let a stall (e.g. a window drag) fast-forward the simulation
+  const float dt =
+      app.lastUpdateNS
+          ? std::min(static_cast<float>(now - app.lastUpdateNS) / 1e9f, 0.1f)
+          : 0.0f;
+  app.lastUpdateNS = now;
+
+  for (ParticleEmitter *emitter : {&app.sparkEmitter, &app.smokeEmitter}) {
+    emitter->x = w * 0.5f;
+    emitter->y = h * 0.9f;
+  }
+  EmitParticles(app.sparks, app.sparkEmitter, dt);
+  EmitParticles(app.smoke, app.smokeEmitter, dt);
+  UpdateParticles(app.sparks, dt);
+  UpdateParticles(app.smoke, dt);
+}
+
+// Stress test for geometry batching: `count` assorted shapes in a grid.
+static void DrawShapeGrid(GLRenderer &renderer, int count, int w, int h,
+                          float time) {
+  const float aspect = static_cast<float>(w) / static_cast<float>(h);
+  const int columns =
+      std::max(1, static_cast<int>(std::ceil(std::sqrt(count * aspect))));
+  const int rows = (count + columns - 1) / columns;
+  const float cellW = static_cast<float>(w) / columns;
+  const float cellH = static_cast<float>(h) / rows;
+  const float size = std::min(cellW, cellH) * 0.4f;
+
+  for (int i = 0; i < count; ++i) {
+    const float cx = (i % columns + 0.5f) * cellW;
+    const float cy = (i / columns + 0.5f) * cellH;
+    const float angle = time + i * 0.1f;
+    const float dx = std::cos(angle) * size;
+    const float dy = std::sin(angle) * size;
+    const SDL_Color color{
+        static_cast<Uint8>(128 + 127 * std::sin(i * 0.7f)),
+        static_cast<Uint8>(128 + 127 * std::sin(i * 1.3f + 2.0f)),
+        static_cast<Uint8>(128 + 127 * std::sin(i * 0.3f + 4.0f)), 200};
+
+    switch (i % 5) {
+    case 0:
+      FillCircle(renderer, cx, cy, size, color);
+      break;
+    case 1:
+      DrawCircle(renderer, cx, cy, size, 2.0f, color);
+      break;
+    case 2:
+      DrawLine(renderer, cx - dx, cy - dy, cx + dx, cy + dy, 3.0f, color);
+      break;
+    case 3:
+      DrawRect(renderer, {cx - size, cy - size, 2 * size, 2 * size}, 2.0f,
+               color);
+      break;
+    default: {
+      const SDL_FPoint triangle[3] = {{cx + dx, cy + dy},
+                                      {cx - dy, cy + dx},
+                                      {cx - dx * 0.5f, cy - dy * 0.5f}};
+      FillConvexPolygon(renderer, triangle, 3, color);
+      break;
+    }
+    }
+  }
+}
+
+// Draws and presents one frame. Called from SDL_AppIterate and, during
+// live resizes, from the event watch.
+static void RenderFrame(AppContext &app) {
+  app.resize.inFrame = true;
+
+  // once the size has settled, do the work we put off while it changed
+  const uint64_t now = SDL_GetTicksNS();
+  if (app.resize.active && now - app.resize.lastChangeNS > kResizeSettleNS) {
+    app.resize.active = false;
+    if (app.resize.rasterizePending) {
+      app.resize.rasterizePending = false;
+      RasterizeText(app);
+      AddFullDamage(app.damage);
+    }
+  }
+
+  // animated background colour
+  float time = app.options.staticBackground ? 0.0f : SDL_GetTicks() / 1000.0f;
+  float red = (std::sin(time) + 1.0f) * 0.5f;
+  float green = (std::sin(time / 2.0f) + 1.0f) * 0.5f;
+  float blue = (std::sin(time * 2.0f) + 1.0f) * 0.5f;
+
+  int winW, winH;
+  SDL_GetWindowSizeInPixels(app.window, &winW, &winH);
+  UpdateLayout(app, winW, winH);
+
+  // work out what changes this frame
+  const uint64_t inputNS = TakeFrameInput(app.latency);
+  if (!app.options.staticBackground || (inputNS && app.latencyTest.timer)) {
+    AddFullDamage(app.damage);
+  }
+  // the cursor may be latched anywhere, so a partial redraw could clip it
+  if (app.options.softCursor && UpdateSoftCursor(app)) {
+    AddFullDamage(app.damage);
+  }
+  if (app.options.particles) {
+    AddFullDamage(app.damage);
+    UpdateEffects(app, winW, winH);
+  }
+  RunScheduler(app.scheduler);
+  if (app.options.ui) {
+    BuildUI(app, winW);
+  }
+  PumpAsyncLogger(*app.logger);
+  DrainLogConsole(*app.console);
+  if (app.console->changed) {
+    app.console->changed = false;
+    AddFullDamage(app.damage);
+  }
+  if (!app.tilemap.chunks.empty()) {
+    AddFullDamage(app.damage);
+    UpdateTileMapDemo(app, winW, winH);
+  }
+
+  PollTextureUploads(app.uploader);
+  if (app.tiger.source) {
+    // rasterize for the new size only once a live resize has settled
+    if (!app.resize.active) {
+      RequestSvgSize(app.tiger, static_cast<int>(app.layout.vector.w));
+    }
+    if (PollSvgImage(app.tiger, app.gl, app.uploader)) {
+      AddDamage(app.damage, ToPixelRect(app.layout.vector));
+    }
+  }
+
+  // the upscale is clipped to the damage like everything else, so a new
+  // scale has to redraw the whole window or the old one shows around it
+  const float sceneScale =
+      app.renderScale.enabled ? app.renderScale.scale : 1.0f;
+  if (sceneScale != app.renderScale.presentedScale) {
+    app.renderScale.presentedScale = sceneScale;
+    AddFullDamage(app.damage);
+  }
+
+  if (!BeginDamagedFrame(app.damage, app.window)) {
+    // nothing to redraw or present; idle for about a frame instead. The
+    // idle time says nothing about rendering cost, so don't let the render
+    // scale see it.
+    SDL_Delay(static_cast<Uint32>(app.renderScale.targetFrameMs));
+    app.renderScale.lastFrameNS = 0;
+    app.resize.inFrame = false;
+    return;
+  }
+
+  BeginFrame(app.gl, app.window, red, green, blue);
+  if (app.uptimeDue != app.uptimeSeconds) {
+    UpdateUptimeLabel(app, app.uptimeDue);
+  }
+
+  FrameGraph &graph = app.frameGraph;
+  ResetFrameGraph(graph);
+
+  // the image is the "scene": it may be rendered at reduced resolution
+  AppContext *ctx = &app;
+  auto drawScene = [ctx, winW, winH] {
+    DrawTileMap(ctx->gl, ctx->tilemap, ctx->tileCameraX, ctx->tileCameraY,
+                winW, winH);
+
+    // draw image to cover the window
+    const SDL_FRect &r = ctx->layout.image;
+    DrawTexture(ctx->gl, ctx->imageTex, r.x, r.y, r.w, r.h);
+
+    if (ctx->options.particles) {
+      DrawParticles(ctx->gl, ctx->smoke, ctx->particleTex);
+      DrawParticles(ctx->gl, ctx->sparks, ctx->particleTex);
+    }
+  };
+
+  if (app.renderScale.enabled) {
+    // during a live resize, round the target up so that not every
+    // intermediate size allocates a new one
+    RenderTargetDesc sceneDesc{.width = winW, .height = winH};
+    if (app.resize.active) {
+      sceneDesc.width = (winW + 255) / 256 * 256;
+      sceneDesc.height = (winH + 255) / 256 * 256;
+    }
+
+    const FrameGraphResource scene = CreateTransientTarget(graph, sceneDesc);
+    AddPass(graph, "scene", {}, scene, [=] {
+      BeginScaledScene(ctx->gl, ctx->renderScale, winW, winH, red, green,
+                       blue);
+      drawScene();
+      EndScaledScene(ctx->gl, ctx->renderScale);
+    });
+    AddPass(graph, "upscale", {scene}, kBackbuffer, [ctx, scene] {
+      UpscaleScene(ctx->gl, ctx->renderScale,
+                   GetFrameGraphTarget(ctx->frameGraph, scene), ctx->window);
+    });
+  } else {
+    AddPass(graph, "scene", {}, kBackbuffer, drawScene);
+  }
+
+  if (app.options.shapeCount > 0) {
+    AddPass(graph, "shapes", {}, kBackbuffer, [ctx, winW, winH, time] {
+      DrawShapeGrid(ctx->gl, ctx->options.shapeCount, winW, winH, time);
+    });
+  }
+
+  // text is drawn after the upscale so it stays sharp
+  AddPass(graph, "ui", {}, kBackbuffer, [ctx, winW, winH] {
+    // draw text at its destination rect
+    const SDL_FRect &msg = ctx->layout.message;
+    DrawTexture(ctx->gl, ctx->messageTex, msg.x, msg.y, msg.w, msg.h);
+
+    // draw the uptime label below it
+    const SDL_FRect &up = ctx->layout.uptime;
+    DrawTexture(ctx->gl, DynamicTextureFront(ctx->uptimeTex), up.x, up.y, up.w,
+                up.h);
+
+    // vector art, fitted into its box keeping the aspect ratio
+    const SDL_FRect &box = ctx->layout.vector;
+    if (const GLTexture *tiger =
+            BestSvgRaster(ctx->tiger, static_cast<int>(box.w))) {
+      const float fit = std::min(box.w / tiger->width, box.h / tiger->height);
+      const float w = tiger->width * fit;
+      const float h = tiger->height * fit;
+      DrawTexture(ctx->gl, *tiger, box.x + box.w - w, box.y + box.h - h, w, h);
+    }
+
+    UIRender(ctx->gl, ctx->ui);
+    DrawLogConsole(ctx->gl, *ctx->console, ctx->ui.atlas, winW, winH);
+
+    // last, so that it is still in the batch when the final flush latches it
+    if (ctx->options.softCursor && ctx->cursor.visible) {
+      BeginLateLatch(ctx->gl, ctx->cursor.x, ctx->cursor.y);
+      DrawSoftCursor(ctx->gl, ctx->cursor.x, ctx->cursor.y,
+                     SDL_GetWindowPixelDensity(ctx->window));
+      EndLateLatch(ctx->gl);
+    }
+  });
+
+  graph.backbufferScissor =
+      app.damage.partial ? &app.damage.scissor : nullptr;
+  CompileFrameGraph(graph);
+  ExecuteFrameGraph(graph, app.window);
+  if (graph.missingTarget && app.renderScale.enabled) {
+    // the only transient target is the scene's; draw it directly from now on
+    SDL_Log("Render scale disabled: couldn't create the scene target");
+    app.renderScale.enabled = false;
+    AddFullDamage(app.damage);
+  }
+
+  const uint64_t frame = app.gl.frame;
+  const uint64_t presentStart = SDL_GetTicksNS();
+  PresentDamagedFrame(app.damage, app.window);
+  const uint64_t presentEnd = SDL_GetTicksNS();
+  const uint64_t gpuWait = EndFrameInFlight(app.gl, app.options.framesInFlight);
+  RecordPresent(app.presentTiming, presentStart, presentEnd, gpuWait);
+  RecordFrameLatency(app.latency, frame, inputNS, presentEnd);
+  PollFrameLatency(app.latency, app.gl);
+
+  if (app.latencyTest.timer &&
+      app.latency.toPresent.ms.size() >=
+          static_cast<size_t>(app.latencyTest.samples)) {
+    StopLatencyTest(app.latencyTest);
+    app.app_quit = SDL_APP_SUCCESS; // AppQuit logs the results
+  }
+
+  app.resize.inFrame = false;
+}
+
+static bool SDLCALL LiveResizeWatch(void *userdata, SDL_Event *event) {
+  auto *app = static_cast<AppContext *>(userdata);
+
+  switch (event->type) {
+  case SDL_EVENT_WINDOW_RESIZED:
+  case SDL_EVENT_WINDOW_PIXEL_SIZE_CHANGED:
+    app->resize.active = true;
+    app->resize.lastChangeNS = SDL_GetTicksNS();
+    break;
+  case SDL_EVENT_WINDOW_DISPLAY_SCALE_CHANGED:
+    // re-rasterizing text is expensive; wait until things settle
+    app->resize.active = true;
+    app->resize.lastChangeNS = SDL_GetTicksNS();
+    app->resize.rasterizePending = true;
+    break;
+  case SDL_EVENT_WINDOW_EXPOSED:
+    // the window system may have lost what we presented
+    AddFullDamage(app->damage);
+
+    // data1 is set for exposes sent from inside a live resize, which may be
+    // all we get until the user lets go of the edge
+    if (event->window.data1 && SDL_IsMainThread() && !app->resize.inFrame) {
+      RenderFrame(*app);
+    }
+    break;
+  default:
+    break;
+  }
+
+  return true;
+}
+
+// ------------------- SDL callbacks -------------------
+
+// Installed first thing in SDL_AppInit and removed last in SDL_AppQuit, which
+// SDL calls even when init fails, so the message saying why is written out.
+static AsyncLogger *asyncLogger = nullptr;
+static LogConsole *logConsole = nullptr;
+
+SDL_AppResult SDL_AppInit(void **appstate, int argc, char *argv[]) {
+  // capture log output from the start so the console has all of it, then
+  // hand it to the async logger for stderr and the log file
+  auto *logger = asyncLogger = new AsyncLogger{};
+  // per-user writable folder for the log file and the caches, if any
+  std::string prefPath;
+  if (char *path = SDL_GetPrefPath("ravbug", "sdl3-sample")) {
+    prefPath = path;
+    SDL_free(path);
+  }
+#ifdef __EMSCRIPTEN__
+  InstallAsyncLogger(*logger, {});
+#else
+  InstallAsyncLogger(*logger, prefPath.empty() ? std::string{}
+                                               : prefPath + "log.txt");
+#endif
+  auto *console = logConsole = new LogConsole{};
+  InstallLogConsole(*console);
+
+  const AppOptions options = ParseOptions(argc, argv);
+
+  // init the library
+  if (!SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO)) {
     return SDL_Fail();
   }
 
-  // make an OpenGL texture from the surface
-  GLTexture messageTex = CreateTextureFromSurface(surfaceMessage);
+  // init TTF
+  if (!TTF_Init()) {
+    return SDL_Fail();
+  }
 
-  // we no longer need the font or the surface, so we can destroy those now.
-  TTF_CloseFont(font);
-  SDL_DestroySurface(surfaceMessage);
+  // init Mixer
+  if (!MIX_Init()) {
+    return SDL_Fail();
+  }
 
-  if (!messageTex.id) {
+  // ask X11 compositors to leave our window alone when it covers the screen,
+  // so fullscreen frames skip the compositor. Other platforms bypass it on
+  // their own (or never do), so there is nothing to ask for there.
+  SDL_SetHint(SDL_HINT_VIDEO_X11_NET_WM_BYPASS_COMPOSITOR, "1");
+
+  // create a window (with OpenGL)
+  SDL_Window *window = SDL_CreateWindow(
+      "SDL Minimal Sample (OpenGL)", windowStartWidth, windowStartHeight,
+      SDL_WINDOW_RESIZABLE | SDL_WINDOW_HIGH_PIXEL_DENSITY | SDL_WINDOW_OPENGL);
+  if (!window) {
     return SDL_Fail();
   }
 
-  // get the on-screen dimensions of the text
-  SDL_FRect text_rect{
-      .x = 0.0f,
-      .y = 0.0f,
-      .w = static_cast<float>(messageTex.width),
-      .h = static_cast<float>(messageTex.height),
-  };
+  // init our OpenGL renderer
+  GLRenderer glRenderer;
+  if (!InitGL(window, glRenderer)) {
+    return SDL_Fail();
+  }
+
+  if (options.benchParticles > 0) {
+    BenchmarkParticles(glRenderer, window, options.benchParticles);
+    ShutdownGL(window, glRenderer);
+    SDL_DestroyWindow(window);
+    return SDL_APP_SUCCESS;
+  }
+
+  // load the font
+#if __ANDROID__
+  const char *basePath = "assets/";
+#else
+  const char *basePath = SDL_GetBasePath();
+  if (!basePath) {
+    return SDL_Fail();
+  }
+#endif
+
+  // decode the image (PNG in the sample) on a worker while the font loads.
+  // It is often drawn smaller than its native size, so it gets mipmaps.
+  std::string imageCacheDir;
+#ifndef __EMSCRIPTEN__
+  // (the web build's file system doesn't outlive the page)
+  if (!prefPath.empty()) {
+    imageCacheDir = prefPath + "image-cache/";
+    if (!SDL_CreateDirectory(imageCacheDir.c_str())) {
+      imageCacheDir.clear();
+    }
+  }
+#endif
+  // it covers the window, so anything bigger than that is wasted
+  int pixelW, pixelH;
+  SDL_GetWindowSizeInPixels(window, &pixelW, &pixelH);
+  const AssetId logoAsset =
+      PickImageVariant(AssetId::logo_png, pixelW, pixelH,
+                       SDL_GetWindowPixelDensity(window));
+  SDL_LogDebug(SDL_LOG_CATEGORY_CUSTOM, "Loading %s for %dx%d pixels",
+               GetAsset(logoAsset).path, pixelW, pixelH);
+
+  // read everything we load at startup in one go
+  std::vector<AssetId> startupAssets = {
+      logoAsset, AssetId::Inter_VariableFont_ttf, AssetId::the_entertainer_ogg};
+  if (options.svg) {
+    startupAssets.push_back(AssetId::gs_tiger_svg);
+  }
+  AssetBatch assets;
+  if (!LoadAssetBatch(assets, basePath, startupAssets)) {
+    return SDL_APP_FAILURE;
+  }
 
-  // load the image (PNG in the sample)
-  SDL_Surface *svg_surface =
-      IMG_Load((basePath / "assets/logo.png").string().c_str());
-  if (!svg_surface) {
+  auto logoJob = DecodeImageAsync(
+      GetAsset(logoAsset).path, AssetData(assets, logoAsset),
+      AssetSize(assets, logoAsset), TextureMips::Generate, imageCacheDir);
+
+  // the font stays open: text is re-rasterized when the display scale
+  // changes, and the uptime label every second. It reads from the batch
+  // for as long as it is open.
+  TTF_Font *font = TTF_OpenFontIO(
+      OpenAssetIO(assets, AssetId::Inter_VariableFont_ttf), true, fontSize);
+  if (!font) {
     return SDL_Fail();
   }
 
-  GLTexture imageTex = CreateTextureFromSurface(svg_surface);
-  SDL_DestroySurface(svg_surface);
+  // collect the decoded image
+  DecodedImage logo = logoJob.get();
+  if (!logo.surface) {
+    return SDL_APP_FAILURE;
+  }
+
+  GLTexture imageTex =
+      CreateTextureFromSurface(logo.surface, TextureMips::Generate, &logo.mips);
+  SDL_DestroySurface(logo.surface);
 
   if (!imageTex.id) {
     return SDL_Fail();
@@ -651,20 +6664,21 @@ SDL_AppResult SDL_AppInit(void **appstate, int argc, char *argv[]) {
   }
 
   // load the music
-  auto musicPath = basePath / "assets/the_entertainer.ogg";
-  MIX_Audio *music = MIX_LoadAudio(mixer, musicPath.string().c_str(), false);
+  MIX_Audio *music = MIX_LoadAudio_IO(
+      mixer, OpenAssetIO(assets, AssetId::the_entertainer_ogg), false, true);
   if (!music) {
     return SDL_Fail();
   }
 
-  // play the music (loops)
   MIX_SetTrackAudio(mixerTrack, music);
-  SDL_PropertiesID props = SDL_CreateProperties();
-  SDL_SetNumberProperty(props, MIX_PROP_PLAY_LOOPS_NUMBER, -1);
-  MIX_PlayTrack(mixerTrack, props);
 
   // print some information about the window
   SDL_ShowWindow(window);
+  PresentMode presentMode = options.presentMode;
+  if (presentMode != PresentMode::Windowed &&
+      !SetPresentMode(window, presentMode, options.displayMode)) {
+    presentMode = PresentMode::Windowed;
+  }
   {
     int width, height, bbwidth, bbheight;
     SDL_GetWindowSize(window, &width, &height);
@@ -678,14 +6692,79 @@ SDL_AppResult SDL_AppInit(void **appstate, int argc, char *argv[]) {
 
   auto *app = new AppContext{};
   app->window = window;
-  app->gl = glRenderer;
-  app->messageTex = messageTex;
+  app->options = options;
+  app->logger = logger;
+  app->console = console;
+  app->presentMode = presentMode;
+  app->gl = std::move(glRenderer);
+  app->assets = std::move(assets);
+  InitDamageTracking(app->damage, window);
+  app->frameGraph.renderer = &app->gl;
+  app->frameGraph.pool = &app->renderTargets;
+  if (options.uploadThread &&
+      InitTextureUploader(app->uploader, window, app->gl)) {
+    SDL_Log("Uploading textures on a shared context");
+  }
+
+  app->renderScale.enabled = options.renderScaleEnabled;
+  if (options.renderScaleFixed > 0.0f) {
+    app->renderScale.automatic = false;
+    app->renderScale.scale = options.renderScaleFixed;
+  }
+  if (app->renderScale.enabled) {
+    InitRenderScale(app->renderScale, window);
+  }
   app->imageTex = imageTex;
-  app->messageDest = text_rect;
+  if (options.particles) {
+    InitEffects(*app);
+  }
+  if (options.svg) {
+    LoadSvgImage(app->tiger, GetAsset(AssetId::gs_tiger_svg).path,
+                 AssetData(app->assets, AssetId::gs_tiger_svg).get(),
+                 AssetSize(app->assets, AssetId::gs_tiger_svg), prefPath);
+  }
+  if (options.tilemap && !InitTileMapDemo(*app)) {
+    SDL_LogWarn(SDL_LOG_CATEGORY_CUSTOM, "Tile map demo unavailable");
+  }
+  app->font = font;
   app->track = mixerTrack;
 
+  // play the music (loops)
+  if (!InstallAudioCommands(app->audio, mixer)) {
+    return SDL_Fail();
+  }
+  AudioPlay(app->audio, app->track, -1);
+
   *appstate = app;
 
+  // render the text for the window's current display scale
+  if (!RasterizeText(*app)) {
+    return SDL_APP_FAILURE;
+  }
+
+  Spawn(app->scheduler, UptimeLabelLoop(*app));
+  if (!app->tilemap.chunks.empty()) {
+    Spawn(app->scheduler, TileMapTickLoop(*app));
+  }
+
+  if (options.softCursor) {
+    // Wayland only reports the pointer to the focused surface, via events
+    const char *driver = SDL_GetCurrentVideoDriver();
+    app->cursor.globalPointer = !driver || SDL_strcmp(driver, "wayland") != 0;
+    SetLateLatchSampler(app->gl, SampleLatestPointer, app);
+    SDL_HideCursor();
+  }
+
+  if (options.latencyTest > 0 &&
+      !StartLatencyTest(app->latencyTest, window, options.latencyTest)) {
+    return SDL_Fail();
+  }
+
+  // keep drawing while the user drags the window edge
+  if (!SDL_AddEventWatch(LiveResizeWatch, app)) {
+    return SDL_Fail();
+  }
+
   SDL_Log("Application started successfully (OpenGL renderer)!");
 
   return SDL_APP_CONTINUE;
@@ -697,6 +6776,34 @@ SDL_AppResult SDL_AppEvent(void *appstate, SDL_Event *event) {
   if (event->type == SDL_EVENT_QUIT) {
     app->app_quit = SDL_APP_SUCCESS;
   }
+  if (IsInputEvent(event->type)) {
+    NoteInput(app->latency, event->common.timestamp);
+  }
+
+  // the console, then the UI get first pick of input; what they consume
+  // goes no further
+  if (LogConsoleHandleEvent(*app->console, *event)) {
+    return SDL_APP_CONTINUE;
+  }
+  if (app->options.ui && UIHandleEvent(app->ui, *event)) {
+    return SDL_APP_CONTINUE;
+  }
+
+  // F11 cycles windowed -> borderless -> exclusive, reporting how the mode
+  // we leave performed: present timing and input-to-present latency
+  if (event->type == SDL_EVENT_KEY_DOWN && event->key.key == SDLK_F11 &&
+      !event->key.repeat) {
+    auto next = static_cast<PresentMode>(
+        (static_cast<int>(app->presentMode) + 1) %
+        static_cast<int>(PresentMode::Count));
+    LogPresentTiming(app->presentMode, app->presentTiming);
+    LogLatency(app->latency);
+    if (SetPresentMode(app->window, next, app->options.displayMode)) {
+      app->presentMode = next;
+      app->presentTiming = {};
+      ResetLatency(app->latency);
+    }
+  }
 
   return SDL_APP_CONTINUE;
 }
@@ -704,26 +6811,7 @@ SDL_AppResult SDL_AppEvent(void *appstate, SDL_Event *event) {
 SDL_AppResult SDL_AppIterate(void *appstate) {
   auto *app = static_cast<AppContext *>(appstate);
 
-  // animated background colour
-  float time = SDL_GetTicks() / 1000.0f;
-  float red = (std::sin(time) + 1.0f) * 0.5f;
-  float green = (std::sin(time / 2.0f) + 1.0f) * 0.5f;
-  float blue = (std::sin(time * 2.0f) + 1.0f) * 0.5f;
-
-  BeginFrame(app->gl, app->window, red, green, blue);
-
-  int winW, winH;
-  SDL_GetWindowSizeInPixels(app->window, &winW, &winH);
-
-  // draw image to cover the window
-  DrawTexture(app->gl, app->imageTex, 0.0f, 0.0f, static_cast<float>(winW),
-              static_cast<float>(winH));
-
-  // draw text at its destination rect
-  DrawTexture(app->gl, app->messageTex, app->messageDest.x, app->messageDest.y,
-              app->messageDest.w, app->messageDest.h);
-
-  EndFrame(app->window);
+  RenderFrame(*app);
 
   return app->app_quit;
 }
@@ -732,24 +6820,56 @@ void SDL_AppQuit(void *appstate, SDL_AppResult result) {
   (void)result;
 
   auto *app = static_cast<AppContext *>(appstate);
+  std::shared_ptr<uint8_t[]> assetArena;
   if (app) {
+    SDL_RemoveEventWatch(LiveResizeWatch, app);
+    StopLatencyTest(app->latencyTest);
+    LogPresentTiming(app->presentMode, app->presentTiming);
+    LogLatency(app->latency);
+
     // fade out music a bit
-    if (app->track) {
-      MIX_StopTrack(app->track, MIX_TrackMSToFrames(app->track, 1000));
+    if (app->track && AudioStop(app->audio, app->track, 1000)) {
       std::this_thread::sleep_for(std::chrono::milliseconds(1000));
     }
-
-    DestroyTexture(app->messageTex);
-    DestroyTexture(app->imageTex);
+    RemoveAudioCommands(app->audio);
+
+    ShutdownScheduler(app->scheduler);
+
+    RetireTexture(app->gl, app->messageTex);
+    RetireTexture(app->gl, app->imageTex);
+    RetireTexture(app->gl, app->particleTex);
+    DestroyGlyphAtlas(app->gl, app->ui.atlas);
+    DestroySvgImage(app->gl, app->tiger);
+    ShutdownTextureUploader(app->uploader);
+    RetireTexture(app->gl, app->tilemap.tileset);
+    DestroyTileMap(app->gl, app->tilemap);
+    DestroyDynamicTexture(app->gl, app->uptimeTex);
+    ShutdownRenderScale(app->renderScale);
+    DestroyRenderTargetPool(app->renderTargets, app->gl);
+    SDL_DestroySurface(app->uptimeCanvas);
+    if (app->font) {
+      TTF_CloseFont(app->font);
+    }
 
     ShutdownGL(app->window, app->gl);
     SDL_DestroyWindow(app->window);
 
+    assetArena = std::move(app->assets.arena);
     delete app;
   }
 
+  if (logConsole) {
+    RemoveLogConsole(*logConsole);
+    delete std::exchange(logConsole, nullptr);
+  }
+  if (asyncLogger) {
+    RemoveAsyncLogger(*asyncLogger);
+    delete std::exchange(asyncLogger, nullptr);
+  }
+
   TTF_Quit();
   MIX_Quit();
+  assetArena.reset(); // the mixer may have streamed from it until now
 
   SDL_Log("Application quit successfully!");
   SDL_Quit();